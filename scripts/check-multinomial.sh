@@ -0,0 +1,104 @@
+#!/bin/bash
+export LC_ALL=C.UTF-8
+
+# Checks that the multinomial sampling (--multinomial) draws from the same distribution as sampling every shot
+# for a state spread thinly over many outcomes (Hadamard on all qubits and a rotated qubit 0, P(qubit 0 = 1) = 0.146).
+# With few samples most outcomes are pruned from the enumerated support, so the sampling has to fall back to sampling
+# every shot (the result must then be the same as without --multinomial), with many samples none of them are.
+# Usage: ./scripts/check-multinomial.sh [-t TYPE] [QUBITS]
+# It is assumed that the script is run from the repository's home folder.
+
+#####################################################################################
+# Constants:
+
+EXEC="./QuasimodoSim"
+TYPE="CFLOBDD"
+QUBITS=13
+REF_SAMPLES=20000     # Samples of the reference run sampling every shot
+FEW_SAMPLES=8         # Samples of a single multinomial run with pruned outcomes
+FEW_RUNS=20           # Number of the multinomial runs (seeds) with FEW_SAMPLES
+MANY_SAMPLES=20000    # Samples of a single multinomial run without pruned outcomes
+MAX_SUPPORT=100000
+
+#####################################################################################
+# Functions:
+
+# Prints the circuit with the given number of qubits
+circuit() {
+    local n=$1
+    echo "OPENQASM 2.0;"
+    echo "qreg q[$n];"
+    echo "creg c[$n];"
+    for ((i = 1; i < n; i++)); do
+        echo "h q[$i];"
+    done
+    echo "h q[0];"
+    echo "t q[0];"
+    echo "h q[0];"
+    for ((i = 0; i < n; i++)); do
+        echo "measure q[$i] -> c[$i];"
+    done
+}
+
+# Prints the number of samples with qubit 0 set and the total number of samples (read from the simulator output)
+count_q0() {
+    awk -F"'" '/^ +\x27/ { split($3, f, " "); if (substr($2, length($2), 1) == "1") one += f[1]; total += f[1] }
+               END { printf "%d %d\n", one, total }'
+}
+
+# Compares the frequencies of qubit 0 (given as counts) with the reference, fails if they differ by more than 5 sigma
+compare() {
+    local name=$1
+    awk -v name="$name" -v one="$2" -v total="$3" -v ref_one="$4" -v ref_total="$5" 'BEGIN {
+        if (total == 0) { printf "%s: no multinomial draws\n", name; exit 0 }
+        p = ref_one / ref_total
+        f = one / total
+        tol = 5 * sqrt(p * (1 - p) * (1 / total + 1 / ref_total))
+        d = (f > p) ? f - p : p - f
+        printf "%s: P(q0=1)=%.4f (reference %.4f, tolerance %.4f) %s\n", name, f, p, tol, (d <= tol) ? "ok" : "MISMATCH"
+        exit (d <= tol) ? 0 : 1
+    }'
+}
+
+#####################################################################################
+# Output:
+if [[ "$1" = "-t" ]]; then
+    TYPE=$2
+    shift 2
+fi
+if [[ -n "$1" ]]; then
+    QUBITS=$1
+fi
+
+tmp_file=$(mktemp)
+trap 'rm -f "$tmp_file"' EXIT
+circuit "$QUBITS" >"$tmp_file"
+
+read -r ref_one ref_total < <($EXEC -t $TYPE -f "$tmp_file" -m -n $REF_SAMPLES | count_q0)
+
+status=0
+few_one=0
+few_total=0
+fallbacks=0
+every_shot=$($EXEC -t $TYPE -f "$tmp_file" -m -n $FEW_SAMPLES)
+for ((seed = 1; seed <= FEW_RUNS; seed++)); do
+    out=$($EXEC -t $TYPE -f "$tmp_file" -m -n $FEW_SAMPLES --seed $seed --multinomial=$MAX_SUPPORT -i)
+    if grep -q "^Sampling=every shot" <<<"$out"; then
+        fallbacks=$((fallbacks + 1))
+        if [[ "$(grep -v "=" <<<"$out")" != "$every_shot" ]]; then
+            echo "multinomial, seed $seed: fell back, but the result differs from sampling every shot MISMATCH"
+            status=1
+        fi
+        continue
+    fi
+    read -r one total < <(count_q0 <<<"$out")
+    few_one=$((few_one + one))
+    few_total=$((few_total + total))
+done
+echo "multinomial, $FEW_SAMPLES samples: $fallbacks of $FEW_RUNS runs fell back to sampling every shot"
+
+read -r many_one many_total < <($EXEC -t $TYPE -f "$tmp_file" -m -n $MANY_SAMPLES --seed 1 --multinomial=$MAX_SUPPORT | count_q0)
+
+compare "multinomial, $((FEW_RUNS - fallbacks)) x $FEW_SAMPLES samples" $few_one $few_total $ref_one $ref_total || status=1
+compare "multinomial, $MANY_SAMPLES samples" $many_one $many_total $ref_one $ref_total || status=1
+exit $status
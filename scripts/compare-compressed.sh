@@ -0,0 +1,58 @@
+#!/bin/bash
+export LC_ALL=C.UTF-8
+
+# Compares the end-to-end time of simulating compressed circuits directly (streamed decompression)
+# with decompressing them to a temporary file first.
+# Usage: ./scripts/compare-compressed.sh [-t TYPE] FILE.qasm.gz|FILE.qasm.zst...
+# It is assumed that the script is run from the repository's home folder.
+
+#####################################################################################
+# Constants:
+
+EXEC="./QuasimodoSim"
+TYPE="CFLOBDD"
+SEP=","
+
+#####################################################################################
+# Functions:
+
+# Prints the wall-clock time of the given command in seconds
+measure() {
+    local start
+    local end
+    start=$(date +%s.%N)
+    "$@" >/dev/null || return 1
+    end=$(date +%s.%N)
+    awk -v s="$start" -v e="$end" 'BEGIN { printf "%.3f", e - s }'
+}
+
+# Decompresses the given file to the given path and simulates it
+decompress_first() {
+    local file=$1
+    local tmp=$2
+
+    case "$file" in
+        *.gz)  gzip -dc "$file" >"$tmp" ;;
+        *.zst) zstd -qdc "$file" >"$tmp" ;;
+        *)     cp "$file" "$tmp" ;;
+    esac
+    $EXEC -t $TYPE -f "$tmp"
+}
+
+#####################################################################################
+# Output:
+if [[ "$1" = "-t" ]]; then
+    TYPE=$2
+    shift 2
+fi
+
+tmp_file=$(mktemp)
+trap 'rm -f "$tmp_file"' EXIT
+
+printf "%s$SEP%s$SEP%s$SEP%s\n" "Circuit" "Compressed size" "Streamed t" "Decompress first t"
+for file in "$@"; do
+    size=$(stat -c %s "$file")
+    streamed=$(measure $EXEC -t $TYPE -f "$file") || streamed="Error"
+    first=$(measure decompress_first "$file" "$tmp_file") || first="Error"
+    printf "%s$SEP%s$SEP%s$SEP%s\n" "$(basename "$file")" "$size" "$streamed" "$first"
+done
@@ -0,0 +1,442 @@
+#include <math.h>
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <algorithm>
+
+#include "bench.h"
+#include "quasimodosim.h"
+
+#define TIME_ABS_TOL 0.05   // Absolute time difference (s) always tolerated by the regression check (timer noise)
+#define MEM_ABS_TOL 2048    // Absolute memory difference (kB) always tolerated by the regression check
+#define PROB_TOL 1e-6       // Max. difference of the result fingerprint
+#define JSON_LINE_MAX_LEN 512
+
+/** Benchmarked backends by default. */
+static const char *all_backends[] = {"CFLOBDD", "WCFLOBDD", "BDD", "WBDD"};
+
+typedef struct bench_result {    // Result of a single benchmark run
+    std::string family;
+    std::string backend;
+    int qubits;
+    int depth;
+    std::string status;          // "ok", "TO" (timeout) or "Error"
+    double time;                 // Simulation time in seconds
+    long mem;                    // Peak memory in kB
+    long double prob;            // Probability of the expected state (the result fingerprint)
+    std::string fused_status;    // Results of the run with the gate fusion (only if enabled)
+    double fused_time;
+    long double fused_prob;
+    size_t gates_saved;          // Number of gates removed by the fusion
+} bench_result_t;
+
+typedef struct bench_msg {       // Result sent by the forked run
+    bool ok;
+    double time;
+    long mem;
+    long double prob;
+} bench_msg_t;
+
+void bench_parse_range(const char *str, bench_range_t *range)
+{
+    long vals[3];
+    int cnt = 0;
+    const char *p = str;
+    char *endptr;
+
+    while (cnt < 3) {
+        vals[cnt++] = strtol(p, &endptr, 10);
+        if (endptr == p || vals[cnt - 1] < 0 || vals[cnt - 1] > INT_MAX) {
+            error_exit("Invalid range '%s'.\n", str);
+        }
+        if (*endptr == '\0') {
+            break;
+        }
+        else if (*endptr != ':') {
+            error_exit("Invalid range '%s'.\n", str);
+        }
+        p = endptr + 1;
+    }
+    if (*endptr != '\0') {
+        error_exit("Invalid range '%s'.\n", str);
+    }
+
+    range->start = vals[0];
+    range->end = (cnt > 1) ? vals[1] : vals[0];
+    range->step = (cnt > 2) ? vals[2] : 1;
+    if (range->step <= 0 || range->end < range->start) {
+        error_exit("Invalid range '%s'.\n", str);
+    }
+}
+
+/**
+ * Runs a single benchmark circuit in a forked process, sets the status, time, memory and fingerprint of the result
+ */
+static void bench_one(const gen_circ_t *circ, const bench_opts_t *opts, bool fuse, bench_result_t *res)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        error_exit("Could not create a pipe for the benchmark run.\n");
+    }
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        error_exit("Could not start the benchmark run.\n");
+    }
+    else if (pid == 0) {
+        close(fds[0]);
+        if (opts->mem) {
+            struct rlimit rl;
+            rl.rlim_cur = rl.rlim_max = opts->mem * 1024 * 1024;
+            setrlimit(RLIMIT_AS, &rl);
+        }
+        if (opts->timeout) {
+            alarm(opts->timeout);
+        }
+
+        QuasimodoSim sim;
+        qsim_opts_t sim_opts;
+        qsim_result_t sim_res;
+        sim_opts.sim_type = res->backend;
+        sim_opts.fuse = fuse;
+        sim_opts.amplitudes.push_back(circ->expected);
+
+        bench_msg_t msg;
+        msg.ok = (sim.run_string(circ->qasm, sim_opts, &sim_res) == QSIM_OK);
+        msg.time = sim_res.time;
+        msg.mem = sim_res.peak_mem;
+        msg.prob = msg.ok ? sim_res.probabilities[0] : 0;
+        if (!msg.ok) {
+            fprintf(stderr, "%s%s\n", ERROR_TEXT, sim_res.error.c_str());
+        }
+        _exit(write(fds[1], &msg, sizeof(msg)) == sizeof(msg) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    bench_msg_t msg;
+    ssize_t len;
+    while ((len = read(fds[0], &msg, sizeof(msg))) < 0 && errno == EINTR) {}
+    close(fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+
+    res->time = 0;
+    res->mem = 0;
+    res->prob = 0;
+    if (len == sizeof(msg) && msg.ok) {
+        res->status = "ok";
+        res->time = msg.time;
+        res->mem = msg.mem;
+        res->prob = msg.prob;
+    }
+    else if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) {
+        res->status = "TO";
+    }
+    else {
+        res->status = "Error";
+    }
+}
+
+/**
+ * Returns the number of gates removed from the circuit by the gate fusion
+ */
+static size_t count_fused(const gen_circ_t *circ)
+{
+    FILE *in = fmemopen((void*)circ->qasm.data(), circ->qasm.size(), "r");
+    if (in == NULL) {
+        error_exit("Could not open the generated circuit.\n");
+    }
+    circuit_t circuit;
+    fuse_stats_t stats;
+    parse_file(in, &circuit);
+    fclose(in);
+    fuse_circuit(&circuit, &stats);
+    return stats.gates_before - stats.gates_after;
+}
+
+/**
+ * Prints the gates saved and the time difference of the fused runs for every family, returns the number of runs
+ * whose fused result differs
+ */
+static unsigned fuse_summary(const std::vector<bench_result_t>& results, FILE *output)
+{
+    std::vector<std::string> families;
+    for (const bench_result_t& r : results) {
+        if (std::find(families.begin(), families.end(), r.family) == families.end()) {
+            families.push_back(r.family);
+        }
+    }
+
+    unsigned mismatches = 0;
+    for (const bench_result_t& r : results) {
+        if (r.status == "ok" && r.fused_status == "ok" && fabsl(r.prob - r.fused_prob) > PROB_TOL) {
+            fprintf(output, "FUSION MISMATCH %s/%s/q=%d/d=%d: fingerprint %.10Lg (unfused %.10Lg)\n", r.family.c_str(),
+                    r.backend.c_str(), r.qubits, r.depth, r.fused_prob, r.prob);
+            mismatches++;
+        }
+    }
+
+    fprintf(output, "Fusion summary (runs finished both with and without the fusion):\n");
+    for (const std::string& family : families) {
+        size_t saved = 0;
+        unsigned runs = 0;
+        double time = 0, fused_time = 0;
+        for (const bench_result_t& r : results) {
+            if (r.family == family && r.status == "ok" && r.fused_status == "ok") {
+                saved += r.gates_saved;
+                runs++;
+                time += r.time;
+                fused_time += r.fused_time;
+            }
+        }
+        fprintf(output, "    %s: %u runs, %zu gates saved, Time=%.4gs -> %.4gs (%+.4gs)\n", family.c_str(), runs, saved,
+                time, fused_time, fused_time - time);
+    }
+    return mismatches;
+}
+
+/**
+ * Finds the value of the given key on a JSON line, returns NULL if the key is not present
+ */
+static const char* json_find(const char *line, const char *key)
+{
+    char pattern[JSON_LINE_MAX_LEN];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *p = strstr(line, pattern);
+    if (p == NULL) {
+        return NULL;
+    }
+    p += strlen(pattern);
+    while (isspace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * Loads a string value of the given key from a JSON line
+ */
+static bool json_get_str(const char *line, const char *key, std::string *val)
+{
+    const char *p = json_find(line, key);
+    if (p == NULL || *p != '"') {
+        return false;
+    }
+    const char *end = strchr(p + 1, '"');
+    if (end == NULL) {
+        return false;
+    }
+    val->assign(p + 1, end);
+    return true;
+}
+
+/**
+ * Loads a number value of the given key from a JSON line
+ */
+static bool json_get_num(const char *line, const char *key, long double *val)
+{
+    const char *p = json_find(line, key);
+    char *endptr;
+    if (p == NULL) {
+        return false;
+    }
+    *val = strtold(p, &endptr);
+    return endptr != p;
+}
+
+/**
+ * Saves the results as JSON (one run per line)
+ */
+static void save_results(const char *path, const bench_opts_t *opts, const std::vector<bench_result_t>& results)
+{
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        error_exit("Invalid output file '%s'.\n", path);
+    }
+
+    fprintf(out, "{\n  \"seed\": %u,\n  \"runs\": [\n", opts->seed);
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result_t& r = results[i];
+        fprintf(out, "    {\"family\": \"%s\", \"backend\": \"%s\", \"qubits\": %d, \"depth\": %d, \"status\": \"%s\", "
+                     "\"time\": %.6g, \"mem\": %ld, \"prob\": %.12Lg}%s\n",
+                r.family.c_str(), r.backend.c_str(), r.qubits, r.depth, r.status.c_str(), r.time, r.mem, r.prob,
+                (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    fclose(out);
+}
+
+/**
+ * Loads the results saved by save_results()
+ */
+static void load_results(const char *path, std::vector<bench_result_t> *results)
+{
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        error_exit("Invalid baseline file '%s'.\n", path);
+    }
+
+    char line[JSON_LINE_MAX_LEN];
+    while (fgets(line, sizeof(line), in) != NULL) {
+        bench_result_t r = bench_result_t();
+        long double qubits = 0, depth = 0, time = 0, mem = 0;
+        if (!json_get_str(line, "family", &r.family)) {
+            continue; // not a run
+        }
+        const char *missing = !json_get_str(line, "backend", &r.backend) ? "backend"
+                              : !json_get_str(line, "status", &r.status) ? "status"
+                              : !json_get_num(line, "qubits", &qubits) ? "qubits"
+                              : !json_get_num(line, "depth", &depth) ? "depth"
+                              : !json_get_num(line, "time", &time) ? "time"
+                              : !json_get_num(line, "mem", &mem) ? "mem"
+                              : !json_get_num(line, "prob", &r.prob) ? "prob"
+                              : NULL;
+        if (missing != NULL) {
+            error_exit("Invalid baseline file '%s' (run entry without a valid '%s' field).\n", path, missing);
+        }
+        r.qubits = qubits;
+        r.depth = depth;
+        r.time = time;
+        r.mem = mem;
+        results->push_back(r);
+    }
+    fclose(in);
+}
+
+/**
+ * Compares the results against the baseline, returns the number of regressions
+ */
+static unsigned check_results(const bench_opts_t *opts, const std::vector<bench_result_t>& results, FILE *output)
+{
+    std::vector<bench_result_t> baseline;
+    load_results(opts->baseline_path, &baseline);
+
+    unsigned compared = 0;
+    unsigned regressions = 0;
+    for (const bench_result_t& r : results) {
+        const bench_result_t *b = NULL;
+        for (const bench_result_t& cand : baseline) {
+            if (cand.family == r.family && cand.backend == r.backend && cand.qubits == r.qubits && cand.depth == r.depth) {
+                b = &cand;
+                break;
+            }
+        }
+        if (b == NULL || b->status != "ok") {
+            continue; // nothing to compare against
+        }
+        compared++;
+
+        char name[JSON_LINE_MAX_LEN];
+        snprintf(name, sizeof(name), "%s/%s/q=%d/d=%d", r.family.c_str(), r.backend.c_str(), r.qubits, r.depth);
+        if (r.status != "ok") {
+            fprintf(output, "REGRESSION %s: status '%s' (baseline 'ok')\n", name, r.status.c_str());
+            regressions++;
+            continue;
+        }
+        if (r.time > b->time * (1 + opts->tolerance) + TIME_ABS_TOL) {
+            fprintf(output, "REGRESSION %s: time %.4gs (baseline %.4gs)\n", name, r.time, b->time);
+            regressions++;
+        }
+        if (r.mem > b->mem * (1 + opts->tolerance) + MEM_ABS_TOL) {
+            fprintf(output, "REGRESSION %s: memory %ldkB (baseline %ldkB)\n", name, r.mem, b->mem);
+            regressions++;
+        }
+        if (fabsl(r.prob - b->prob) > PROB_TOL) {
+            fprintf(output, "REGRESSION %s: result fingerprint %.10Lg (baseline %.10Lg)\n", name, r.prob, b->prob);
+            regressions++;
+        }
+    }
+    fprintf(output, "Regression check against '%s': %u runs compared, %u regressions\n", opts->baseline_path, compared, regressions);
+    return regressions;
+}
+
+int bench_run(const bench_opts_t *opts, FILE *output)
+{
+    // Init:
+    std::vector<const gen_family_t*> families;
+    if (opts->families.empty()) {
+        for (const gen_family_t *f = gen_families(); f->name != NULL; f++) {
+            families.push_back(f);
+        }
+    }
+    for (const std::string& name : opts->families) {
+        const gen_family_t *f = gen_get_family(name.c_str());
+        if (f == NULL) {
+            error_exit("Invalid benchmark family '%s'.\n", name.c_str());
+        }
+        families.push_back(f);
+    }
+    std::vector<std::string> backends = opts->backends;
+    if (backends.empty()) {
+        backends.assign(all_backends, all_backends + sizeof(all_backends) / sizeof(all_backends[0]));
+    }
+
+    // Runs:
+    std::vector<bench_result_t> results;
+    gen_circ_t circ;
+    fprintf(output, "Family,Backend,Qubits,Depth,Status,Time,Memory,Fingerprint%s\n",
+            opts->fuse ? ",FusedStatus,FusedTime,GatesSaved" : "");
+    for (const gen_family_t *f : families) {
+        for (const std::string& backend : backends) {
+            // a failed run (e.g. a timeout) skips all larger runs
+            int fail_depth = INT_MAX;
+            for (int n = opts->qubits.start; n <= opts->qubits.end; n += opts->qubits.step) {
+                if (n < f->min_qubits) {
+                    continue;
+                }
+                int d_start = f->uses_depth ? opts->depths.start : 0;
+                int d_end = f->uses_depth ? opts->depths.end : 0;
+                for (int d = d_start; d <= d_end && d < fail_depth; d += opts->depths.step) {
+                    bench_result_t res;
+                    res.family = f->name;
+                    res.backend = backend;
+                    res.qubits = n;
+                    res.depth = d;
+                    gen_circuit(f, n, d, opts->seed, false, &circ);
+                    bench_one(&circ, opts, false, &res);
+                    if (res.status != "ok") {
+                        fail_depth = d;
+                    }
+
+                    fprintf(output, "%s,%s,%d,%d,%s,%.4f,%ld,%.10Lg", res.family.c_str(), res.backend.c_str(),
+                            res.qubits, res.depth, res.status.c_str(), res.time, res.mem, res.prob);
+                    if (opts->fuse) {
+                        bench_result_t fused = res;
+                        bench_one(&circ, opts, true, &fused);
+                        res.fused_status = fused.status;
+                        res.fused_time = fused.time;
+                        res.fused_prob = fused.prob;
+                        res.gates_saved = count_fused(&circ);
+                        fprintf(output, ",%s,%.4f,%zu", res.fused_status.c_str(), res.fused_time, res.gates_saved);
+                    }
+                    fprintf(output, "\n");
+                    fflush(output);
+                    results.push_back(res);
+                }
+            }
+        }
+    }
+
+    // Output:
+    int ret = 0;
+    if (opts->fuse && fuse_summary(results, output) > 0) {
+        ret = 1;
+    }
+    if (opts->out_path != NULL) {
+        save_results(opts->out_path, opts, results);
+    }
+    if (opts->baseline_path != NULL && check_results(opts, results, output) > 0) {
+        ret = 1;
+    }
+    return ret;
+}
+
+/* end of "bench.c" */
@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "gen.h"
+
+#ifndef BENCH_H
+#define BENCH_H
+
+typedef struct bench_range {     // Range of a benchmark parameter
+    int start;
+    int end;
+    int step;
+} bench_range_t;
+
+typedef struct bench_opts {      // Options of the benchmark suite
+    std::vector<std::string> families;  // Benchmarked families (empty for all)
+    std::vector<std::string> backends;  // Benchmarked backends (empty for all)
+    bench_range_t qubits;
+    bench_range_t depths;        // Only used by the families whose circuits depend on the depth
+    unsigned seed;
+    unsigned timeout;            // Max. runtime of a single run in seconds (0 for no limit)
+    unsigned long mem;           // Max. memory (address space) of a single run in MB (0 for no limit)
+    const char *out_path;        // File for saving the results as JSON (NULL if not saved)
+    const char *baseline_path;   // Baseline JSON the results are compared against (NULL if not compared)
+    double tolerance;            // Allowed relative slowdown and memory growth against the baseline
+    bool fuse;                   // Repeat every run with the gate fusion and report the gates saved
+} bench_opts_t;
+
+/**
+ * Parses a range of the form 'start[:end[:step]]'
+ */
+void bench_parse_range(const char *str, bench_range_t *range);
+
+/**
+ * Runs every benchmarked family on every backend for increasing numbers of qubits and depths (every run
+ * is executed in a forked process, so that its peak memory is measured separately). Prints the scaling
+ * curves as CSV to the given stream and optionally checks the results against a baseline. With the gate fusion
+ * enabled, every run is repeated with the fused circuit and a per-family summary of the fusion is printed.
+ *
+ * @param opts options of the benchmark suite
+ *
+ * @param output stream for the output of results
+ *
+ * @return 0 on success, 1 if a regression against the baseline (or a different result of a fused run) was detected
+ *
+ */
+int bench_run(const bench_opts_t *opts, FILE *output);
+
+#endif
+/* end of "bench.h" */
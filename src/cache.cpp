@@ -0,0 +1,398 @@
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "cache.h"
+
+#define CACHE_VERSION 1          // Version of the key and of the entry format (bumped on every change of either)
+#define CACHE_EXT ".res"         // Extension of the stored results
+#define TMP_PREFIX ".tmp."       // Prefix of the entries being written
+#define TMP_MAX_AGE 3600         // Age in seconds after which an unfinished entry is removed (its writer has died)
+#define STATS_FILE "stats"       // File with the hit and miss counters (also locked while updating them)
+#define LOCK_FILE "lock"         // File locked during the eviction
+
+typedef struct hash128 {         // State of the 128-bit hash
+    uint64_t a;
+    uint64_t b;
+    uint64_t len;                // Number of hashed words
+} hash128_t;
+
+typedef struct cache_entry {     // Stored result found by the directory scan
+    std::string path;
+    struct timespec mtime;       // Time of the last use
+    uint64_t size;
+} cache_entry_t;
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * Final mixing of a hash lane (from MurmurHash3)
+ */
+static uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+/**
+ * Adds a single word to the hash (two lanes mixed as in MurmurHash3, whole words are hashed, so that hashing
+ * large circuits is cheap compared to their parsing)
+ */
+static void hash_word(hash128_t *h, uint64_t w)
+{
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+    h->a ^= rotl(w * c1, 31) * c2;
+    h->a = rotl(h->a, 27) + h->b;
+    h->a = h->a * 5 + 0x52dce729;
+    h->b ^= rotl(w * c2, 33) * c1;
+    h->b = rotl(h->b, 31) + h->a;
+    h->b = h->b * 5 + 0x38495ab5;
+    h->len++;
+}
+
+/**
+ * Adds a string to the hash (prefixed by its length, so that the boundaries of consecutive strings are kept)
+ */
+static void hash_str(hash128_t *h, const std::string& s)
+{
+    hash_word(h, s.size());
+    for (size_t i = 0; i < s.size(); i += 8) {
+        uint64_t w = 0;
+        for (size_t j = i; j < s.size() && j < i + 8; j++) {
+            w = (w << 8) | (unsigned char)s[j];
+        }
+        hash_word(h, w);
+    }
+}
+
+std::string cache_key(const circuit_t& circuit, const qsim_opts_t& opts)
+{
+    hash128_t h = {0x9e3779b97f4a7c15ULL, 0x6a09e667f3bcc908ULL, 0};
+    hash_word(&h, CACHE_VERSION);
+
+    // The options
+    hash_str(&h, opts.sim_type);
+    hash_word(&h, opts.measure);
+    hash_word(&h, opts.samples);
+    hash_word(&h, opts.max_support);
+    hash_word(&h, opts.seed);
+    hash_word(&h, opts.fuse);
+    hash_word(&h, opts.amplitudes.size());
+    for (const std::string& s : opts.amplitudes) {
+        hash_str(&h, s);
+    }
+    hash_word(&h, opts.expects.size());
+    for (const std::string& s : opts.expects) {
+        hash_str(&h, s);
+    }
+
+    // The gate stream
+    hash_word(&h, circuit.n_qubits);
+    hash_word(&h, circuit.gates.size());
+    for (const gate_t& g : circuit.gates) {
+        hash_word(&h, g.type);
+        hash_word(&h, (g.type == GATE_LOOP) ? g.iters : 0);
+        hash_word(&h, g.qubits.size());
+        for (long int q : g.qubits) {
+            hash_word(&h, q);
+        }
+    }
+
+    uint64_t a = h.a ^ h.len;
+    uint64_t b = h.b ^ h.len;
+    a += b;
+    b += a;
+    a = fmix64(a);
+    b = fmix64(b);
+    a += b;
+    b += a;
+
+    char key[33];
+    snprintf(key, sizeof(key), "%016llx%016llx", (unsigned long long)a, (unsigned long long)b);
+    return key;
+}
+
+/**
+ * Returns the path of a file in the cache directory
+ */
+static std::string cache_path(const char *dir, const std::string& name)
+{
+    return std::string(dir) + "/" + name;
+}
+
+/**
+ * Adds the given values to the counters in the statistics file (the file is locked during the update)
+ */
+static void update_stats(const char *dir, unsigned long hits, unsigned long misses, unsigned long evictions)
+{
+    int fd = open(cache_path(dir, STATS_FILE).c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return;
+    }
+    if (flock(fd, LOCK_EX) == 0) {
+        char buf[128] = {0};
+        unsigned long h = 0, m = 0, e = 0;
+        if (pread(fd, buf, sizeof(buf) - 1, 0) > 0) {
+            sscanf(buf, "hits %lu misses %lu evictions %lu", &h, &m, &e);
+        }
+        int len = snprintf(buf, sizeof(buf), "hits %lu misses %lu evictions %lu\n", h + hits, m + misses, e + evictions);
+        if (ftruncate(fd, 0) == 0 && pwrite(fd, buf, len, 0) != len) {
+            fprintf(stderr, "%sCould not update the cache statistics.\n", ERROR_TEXT);
+        }
+        flock(fd, LOCK_UN);
+    }
+    close(fd);
+}
+
+/**
+ * Scans the cache directory for the stored results, unfinished entries of dead writers are removed
+ */
+static void scan_entries(const char *dir, std::vector<cache_entry_t> *entries)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return;
+    }
+    time_t now = time(NULL);
+    size_t ext_len = strlen(CACHE_EXT);
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        std::string name = de->d_name;
+        bool is_entry = name.size() > ext_len && name.compare(name.size() - ext_len, ext_len, CACHE_EXT) == 0;
+        bool is_tmp = name.compare(0, strlen(TMP_PREFIX), TMP_PREFIX) == 0;
+        if (!is_entry && !is_tmp) {
+            continue;
+        }
+
+        std::string path = cache_path(dir, name);
+        struct stat sb;
+        if (stat(path.c_str(), &sb) != 0 || !S_ISREG(sb.st_mode)) {
+            continue;
+        }
+        if (is_tmp) {
+            if (now - sb.st_mtime > TMP_MAX_AGE) {
+                unlink(path.c_str());
+            }
+            continue;
+        }
+        entries->push_back({path, sb.st_mtim, (uint64_t)sb.st_size});
+    }
+    closedir(d);
+}
+
+/**
+ * Removes the least recently used entries until the stored results fit into the size limit, returns the number
+ * of removed entries (the eviction is skipped if another process is already evicting)
+ */
+static unsigned long evict(const char *dir, uint64_t max_size)
+{
+    int fd = open(cache_path(dir, LOCK_FILE).c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return 0;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        return 0;
+    }
+
+    std::vector<cache_entry_t> entries;
+    scan_entries(dir, &entries);
+    uint64_t total = 0;
+    for (const cache_entry_t& e : entries) {
+        total += e.size;
+    }
+
+    unsigned long evicted = 0;
+    if (total > max_size) {
+        std::sort(entries.begin(), entries.end(), [](const cache_entry_t& x, const cache_entry_t& y) {
+            if (x.mtime.tv_sec != y.mtime.tv_sec) {
+                return x.mtime.tv_sec < y.mtime.tv_sec;
+            }
+            return x.mtime.tv_nsec < y.mtime.tv_nsec;
+        });
+        for (size_t i = 0; i < entries.size() && total > max_size; i++) {
+            if (unlink(entries[i].path.c_str()) == 0) {
+                evicted++;
+            }
+            total -= entries[i].size;
+        }
+    }
+
+    flock(fd, LOCK_UN);
+    close(fd);
+    return evicted;
+}
+
+bool cache_init(const char *dir)
+{
+    struct stat sb;
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    return stat(dir, &sb) == 0 && S_ISDIR(sb.st_mode) && access(dir, R_OK | W_OK | X_OK) == 0;
+}
+
+/**
+ * Reads a stored entry, returns false if the entry is invalid
+ */
+static bool read_entry(FILE *f, const std::string& key, qsim_result_t *res)
+{
+    int version, is_measure;
+    char stored_key[33];
+    if (fscanf(f, "QSIMCACHE %d %32s", &version, stored_key) != 2 || version != CACHE_VERSION || key != stored_key) {
+        return false;
+    }
+
+    fuse_stats_t& fs = res->fuse_stats;
+    size_t n_states, n_probs, n_expects;
+    if (fscanf(f, " qubits %d measure %d support %zu", &res->n_qubits, &is_measure, &res->support) != 3
+        || fscanf(f, " time %lf mem %ld", &res->time, &res->peak_mem) != 2
+        || fscanf(f, " fuse %zu %zu %u %u %u", &fs.gates_before, &fs.gates_after, &fs.ladders, &fs.cswaps, &fs.cancelled) != 5
+        || fscanf(f, " histogram %zu", &n_states) != 1) {
+        return false;
+    }
+    res->is_measure = is_measure;
+
+    for (size_t i = 0; i < n_states; i++) {
+        char *state = NULL;
+        unsigned long count;
+        if (fscanf(f, " %ms %lu", &state, &count) != 2) {
+            free(state);
+            return false;
+        }
+        res->histogram[state] = count;
+        free(state);
+    }
+
+    if (fscanf(f, " probabilities %zu", &n_probs) != 1) {
+        return false;
+    }
+    res->probabilities.resize(n_probs);
+    for (size_t i = 0; i < n_probs; i++) {
+        if (fscanf(f, " %Lf", &res->probabilities[i]) != 1) {
+            return false;
+        }
+    }
+    if (fscanf(f, " expectations %zu", &n_expects) != 1) {
+        return false;
+    }
+    res->expectations.resize(n_expects);
+    for (size_t i = 0; i < n_expects; i++) {
+        if (fscanf(f, " %Lf", &res->expectations[i]) != 1) {
+            return false;
+        }
+    }
+
+    char end[4];
+    return fscanf(f, " %3s", end) == 1 && strcmp(end, "end") == 0;
+}
+
+bool cache_load(const char *dir, const std::string& key, qsim_result_t *res)
+{
+    std::string path = cache_path(dir, key + CACHE_EXT);
+    bool found = false;
+    FILE *f = fopen(path.c_str(), "r");
+    if (f != NULL) {
+        *res = qsim_result_t();
+        found = read_entry(f, key, res);
+        fclose(f);
+        if (found) {
+            utimensat(AT_FDCWD, path.c_str(), NULL, 0); // mark as the most recently used
+        }
+        else {
+            *res = qsim_result_t();
+            unlink(path.c_str()); // only written by an incompatible version
+        }
+    }
+    update_stats(dir, found, !found, 0);
+    return found;
+}
+
+/**
+ * Writes the entry, returns false on failure
+ */
+static bool write_entry(FILE *f, const std::string& key, const qsim_result_t& res)
+{
+    const fuse_stats_t& fs = res.fuse_stats;
+    fprintf(f, "QSIMCACHE %d %s\n", CACHE_VERSION, key.c_str());
+    fprintf(f, "qubits %d measure %d support %zu\n", res.n_qubits, res.is_measure, res.support);
+    fprintf(f, "time %a mem %ld\n", res.time, res.peak_mem);
+    fprintf(f, "fuse %zu %zu %u %u %u\n", fs.gates_before, fs.gates_after, fs.ladders, fs.cswaps, fs.cancelled);
+    fprintf(f, "histogram %zu\n", res.histogram.size());
+    for (const auto& state : res.histogram) {
+        fprintf(f, "%s %lu\n", state.first.c_str(), state.second);
+    }
+    // the values are stored in the hexadecimal format to be read back exactly
+    fprintf(f, "probabilities %zu\n", res.probabilities.size());
+    for (long double p : res.probabilities) {
+        fprintf(f, "%La\n", p);
+    }
+    fprintf(f, "expectations %zu\n", res.expectations.size());
+    for (long double e : res.expectations) {
+        fprintf(f, "%La\n", e);
+    }
+    fprintf(f, "end\n");
+    return fflush(f) == 0 && !ferror(f) && fsync(fileno(f)) == 0;
+}
+
+bool cache_store(const char *dir, const std::string& key, const qsim_result_t& res, uint64_t max_size)
+{
+    std::string tmp_path = cache_path(dir, TMP_PREFIX + std::to_string(getpid()) + "." + key);
+    FILE *f = fopen(tmp_path.c_str(), "w");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = write_entry(f, key, res);
+    long size = ftell(f);
+    ok = (fclose(f) == 0) && ok;
+
+    // an entry larger than the whole cache would only evict all other entries
+    if (!ok || (max_size > 0 && (uint64_t)size > max_size)
+        || rename(tmp_path.c_str(), cache_path(dir, key + CACHE_EXT).c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    if (max_size > 0) {
+        unsigned long evicted = evict(dir, max_size);
+        if (evicted > 0) {
+            update_stats(dir, 0, 0, evicted);
+        }
+    }
+    return true;
+}
+
+void cache_get_stats(const char *dir, cache_stats_t *stats)
+{
+    *stats = cache_stats_t();
+    FILE *f = fopen(cache_path(dir, STATS_FILE).c_str(), "r");
+    if (f != NULL) {
+        if (fscanf(f, "hits %lu misses %lu evictions %lu", &stats->hits, &stats->misses, &stats->evictions) != 3) {
+            stats->hits = stats->misses = stats->evictions = 0;
+        }
+        fclose(f);
+    }
+
+    std::vector<cache_entry_t> entries;
+    scan_entries(dir, &entries);
+    stats->entries = entries.size();
+    for (const cache_entry_t& e : entries) {
+        stats->size += e.size;
+    }
+}
+
+/* end of "cache.c" */
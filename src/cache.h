@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include <string>
+
+#include "quasimodosim.h"
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#define CACHE_DEFAULT_SIZE 256 // Default max. size of the cache directory in MB
+
+typedef struct cache_stats {     // Statistics of a cache directory (shared by all processes using it)
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;     // Entries removed to keep the size limit
+    size_t entries;              // Number of stored results
+    uint64_t size;               // Total size of the stored results in bytes
+} cache_stats_t;
+
+/**
+ * Computes the key of a simulation run: a 128-bit hash (in hex) of the parsed gate stream (i.e. independent
+ * of comments, whitespace and formatting of the QASM file) and of all options affecting the result
+ * (backend type, seed, number of samples, sampling method, queries, gate fusion). The hash is not cryptographic.
+ */
+std::string cache_key(const circuit_t& circuit, const qsim_opts_t& opts);
+
+/**
+ * Creates the cache directory if it does not exist
+ *
+ * @return false if the directory could not be created
+ *
+ */
+bool cache_init(const char *dir);
+
+/**
+ * Looks up the result of a run, a found entry is marked as the most recently used. Every lookup is counted
+ * as a hit or a miss in the statistics of the directory.
+ *
+ * @param dir the cache directory
+ *
+ * @param key key of the run computed by cache_key()
+ *
+ * @param res the stored result including the time and peak memory of the original run
+ *
+ * @return true if the result was found
+ *
+ */
+bool cache_load(const char *dir, const std::string& key, qsim_result_t *res);
+
+/**
+ * Stores the result of a successful run. The entry is written to a temporary file and renamed, so that concurrent
+ * readers never see a partial entry. The least recently used entries are then removed until the directory
+ * fits into the size limit.
+ *
+ * @param dir the cache directory
+ *
+ * @param key key of the run computed by cache_key()
+ *
+ * @param res the result
+ *
+ * @param max_size max. total size of the stored results in bytes (0 for no limit)
+ *
+ * @return false if the entry could not be written
+ *
+ */
+bool cache_store(const char *dir, const std::string& key, const qsim_result_t& res, uint64_t max_size);
+
+/**
+ * Reads the statistics of the cache directory
+ */
+void cache_get_stats(const char *dir, cache_stats_t *stats);
+
+#endif
+/* end of "cache.h" */
@@ -1,10 +1,39 @@
 #include "error.h"
 
-void error_exit(const char *error, ...)
+#define ERROR_MSG_MAX_LEN 512 // Max. length of an error message passed in the exception
+
+/** True if the errors should be thrown as exceptions instead of exiting. */
+static thread_local bool is_recoverable = false;
+
+void error_set_recoverable(bool recoverable)
+{
+    is_recoverable = recoverable;
+}
+
+bool error_is_recoverable()
+{
+    return is_recoverable;
+}
+
+/**
+ * Formats the message of a recoverable error (without the trailing newline)
+ */
+static void format_error(char *msg, const char *error, va_list args)
+{
+    vsnprintf(msg, ERROR_MSG_MAX_LEN, error, args);
+
+    // strip the trailing newline
+    size_t len = strlen(msg);
+    if (len > 0 && msg[len - 1] == '\n') {
+        msg[len - 1] = '\0';
+    }
+}
+
+/**
+ * Prints the error message to stderr
+ */
+static void print_error(const char *error, va_list args)
 {
-    va_list args;
-    va_start(args, error);
-    
     // create error message format
     unsigned error_len = strlen(error) + strlen(ERROR_TEXT);
     char msg[error_len + 1];
@@ -12,6 +41,39 @@ void error_exit(const char *error, ...)
     strcat(msg, error);
 
     vfprintf(stderr, msg, args);
+}
+
+void error_exit(const char *error, ...)
+{
+    va_list args;
+    va_start(args, error);
+
+    if (is_recoverable) {
+        char msg[ERROR_MSG_MAX_LEN];
+        format_error(msg, error, args);
+        va_end(args);
+        throw SimError(msg);
+    }
+
+    print_error(error, args);
+    va_end(args);
+
+    exit(1);
+}
+
+void io_error_exit(const char *error, ...)
+{
+    va_list args;
+    va_start(args, error);
+
+    if (is_recoverable) {
+        char msg[ERROR_MSG_MAX_LEN];
+        format_error(msg, error, args);
+        va_end(args);
+        throw SimIOError(msg);
+    }
+
+    print_error(error, args);
     va_end(args);
 
     exit(1);
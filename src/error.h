@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdexcept>
 
 #ifndef ERROR_H
 #define ERROR_H
@@ -9,6 +10,22 @@
 /** Beginning of an error message. */
 #define ERROR_TEXT "ERROR: "
 
+/**
+ * Exception thrown by error_exit() instead of exiting when the errors are recoverable.
+ */
+class SimError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * Exception thrown by io_error_exit() instead of exiting when the errors are recoverable.
+ */
+class SimIOError : public SimError {
+public:
+    using SimError::SimError;
+};
+
 /**
  * Function that handles program exiting in case of error.
  * 
@@ -16,6 +33,38 @@
 */
 void error_exit(const char *error, ...);
 
+/**
+ * Same as error_exit(), but for failures of reading the input (throws SimIOError when the errors are recoverable).
+ *
+ * @param error Error message format.
+*/
+void io_error_exit(const char *error, ...);
+
+/**
+ * Sets whether error_exit() exits the program (default) or throws SimError with the error message
+ * (used by the library, the setting is per thread).
+ */
+void error_set_recoverable(bool recoverable);
+
+/**
+ * Returns true if error_exit() currently throws SimError instead of exiting (in the calling thread).
+ */
+bool error_is_recoverable();
+
+/**
+ * Makes the errors recoverable for the lifetime of the guard, the previous setting is restored when the guard
+ * goes out of scope (also by an exception), so that nested recoverable sections do not reset the outer one.
+ */
+class RecoverableErrorGuard {
+public:
+    RecoverableErrorGuard() : prev(error_is_recoverable()) { error_set_recoverable(true); }
+    ~RecoverableErrorGuard() { error_set_recoverable(prev); }
+    RecoverableErrorGuard(const RecoverableErrorGuard&) = delete;
+    RecoverableErrorGuard& operator=(const RecoverableErrorGuard&) = delete;
+private:
+    bool prev;                   // Setting before the guard was created
+};
+
 /**
  * Custom malloc function including error handling.
  */
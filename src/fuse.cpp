@@ -0,0 +1,336 @@
+#include <algorithm>
+
+#include "fuse.h"
+
+typedef struct fuse_ctx {        // State of the fusion pass
+    const std::vector<gate_t> *gates;
+    int n_qubits;
+    std::vector<bool> clean;     // True for the qubits that are provably |0> at the current position
+    std::vector<gate_t> *out;    // The rewritten gates
+    fuse_stats_t stats;
+} fuse_ctx_t;
+
+/**
+ * Returns true if the gate has the right number of operands and all of them are valid qubit indices
+ */
+static bool valid_operands(const fuse_ctx_t *ctx, const gate_t& g)
+{
+    if (!gate_has_operands(&g)) {
+        return false;
+    }
+    size_t n_operands = (g.type == GATE_MEASURE) ? 1 : g.qubits.size();
+    for (size_t i = 0; i < n_operands; i++) {
+        if (g.qubits[i] < 0 || g.qubits[i] >= ctx->n_qubits) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Marks the qubits whose basis state may be changed by the gate as not clean (diagonal gates keep |0>)
+ */
+static void mark_dirty(fuse_ctx_t *ctx, const gate_t& g)
+{
+    switch (g.type) {
+        case GATE_Z:
+        case GATE_S:
+        case GATE_T:
+        case GATE_CZ:
+        case GATE_MEASURE:
+        case GATE_LOOP:
+        case GATE_LOOP_END:
+            return;
+        default:
+            break;
+    }
+    size_t first = g.qubits.size() - 1; // the target
+    if (g.type == GATE_CSWAP) {
+        first = 1;
+    }
+    else if (g.type == GATE_SWAP) {
+        first = 0;
+    }
+    for (size_t i = first; i < g.qubits.size(); i++) {
+        if (g.qubits[i] >= 0 && g.qubits[i] < ctx->n_qubits) {
+            ctx->clean[g.qubits[i]] = false;
+        }
+    }
+}
+
+/**
+ * Returns true if both gates are the same ccx (with any order of the controls)
+ */
+static bool same_ccx(const gate_t& a, const gate_t& b)
+{
+    return a.type == GATE_CCX && b.type == GATE_CCX && a.qubits[2] == b.qubits[2]
+           && ((a.qubits[0] == b.qubits[0] && a.qubits[1] == b.qubits[1])
+               || (a.qubits[0] == b.qubits[1] && a.qubits[1] == b.qubits[0]));
+}
+
+/**
+ * Returns true if the gates are identical self-inverse controlled gates (the order of the controls does not matter)
+ */
+static bool cancels(const gate_t& a, const gate_t& b)
+{
+    if (a.type != b.type || a.qubits.size() != b.qubits.size() || !gate_has_operands(&a)) {
+        return false;
+    }
+    if (a.type == GATE_CCX) {
+        return same_ccx(a, b);
+    }
+    else if (a.type == GATE_CSWAP) {
+        return a.qubits == b.qubits;
+    }
+    else if (a.type == GATE_MCX) {
+        std::vector<long int> ca(a.qubits.begin(), a.qubits.end() - 1);
+        std::vector<long int> cb(b.qubits.begin(), b.qubits.end() - 1);
+        std::sort(ca.begin(), ca.end());
+        std::sort(cb.begin(), cb.end());
+        return a.qubits.back() == b.qubits.back() && ca == cb;
+    }
+    return false;
+}
+
+/**
+ * Returns true if the qubit is in the given list
+ */
+static bool contains(const std::vector<long int>& qubits, long int q)
+{
+    return std::find(qubits.begin(), qubits.end(), q) != qubits.end();
+}
+
+/**
+ * Matches a Toffoli ladder starting at the given gate, returns the number of matched gates (0 if there is no ladder)
+ */
+static size_t match_ladder(const fuse_ctx_t *ctx, size_t i, size_t end, gate_t *fused)
+{
+    const std::vector<gate_t>& gates = *ctx->gates;
+    std::vector<long int> anc;   // ancilla of every rung
+    std::vector<long int> ctrls; // controls of the rungs (two for the first one, one for every other)
+
+    // Collect the longest possible compute part
+    for (size_t k = i; k < end && gates[k].type == GATE_CCX && valid_operands(ctx, gates[k]); k++) {
+        const gate_t& g = gates[k];
+        long int a = g.qubits[2];
+        if (anc.empty()) {
+            if (a == g.qubits[0] || a == g.qubits[1]) {
+                break;
+            }
+            ctrls.push_back(g.qubits[0]);
+            ctrls.push_back(g.qubits[1]);
+        }
+        else {
+            long int c;
+            if (g.qubits[0] == anc.back()) {
+                c = g.qubits[1];
+            }
+            else if (g.qubits[1] == anc.back()) {
+                c = g.qubits[0];
+            }
+            else {
+                break;
+            }
+            if (c == a || contains(anc, c)) {
+                break;
+            }
+            ctrls.push_back(c);
+        }
+        if (!ctx->clean[a] || contains(anc, a) || contains(ctrls, a)) {
+            if (anc.empty()) {
+                return 0;
+            }
+            ctrls.pop_back();
+            break;
+        }
+        anc.push_back(a);
+    }
+
+    // Find the longest ladder with a middle gate and a matching uncompute part
+    for (size_t len = anc.size(); len > 0; len--) {
+        size_t m = i + len;
+        if (m + len >= end) {
+            continue;
+        }
+        const gate_t& mid = gates[m];
+        if ((mid.type != GATE_CX && mid.type != GATE_CCX && mid.type != GATE_MCX) || !valid_operands(ctx, mid)) {
+            continue;
+        }
+
+        std::vector<long int> ladder_anc(anc.begin(), anc.begin() + len);
+        std::vector<long int> controls(ctrls.begin(), ctrls.begin() + len + 1);
+        long int last = ladder_anc.back();
+        long int target = mid.qubits.back();
+        bool has_last = false;
+        bool ok = !contains(ladder_anc, target) && !contains(controls, target);
+        for (size_t k = 0; k + 1 < mid.qubits.size() && ok; k++) {
+            long int q = mid.qubits[k];
+            if (q == last && !has_last) {
+                has_last = true;
+            }
+            else if (contains(ladder_anc, q) || q == target) {
+                ok = false;
+            }
+            else if (!contains(controls, q)) {
+                controls.push_back(q);
+            }
+        }
+        if (!ok || !has_last) {
+            continue;
+        }
+
+        // The uncompute part must restore the ancillas in the reverse order
+        for (size_t k = 0; k < len && ok; k++) {
+            ok = same_ccx(gates[m + 1 + k], gates[i + len - 1 - k]);
+        }
+        if (!ok) {
+            continue;
+        }
+
+        // The duplicate controls of the rungs are merged
+        std::vector<long int> uniq;
+        for (long int q : controls) {
+            if (!contains(uniq, q)) {
+                uniq.push_back(q);
+            }
+        }
+        fused->type = (uniq.size() == 2) ? GATE_CCX : GATE_MCX;
+        fused->qubits = uniq;
+        fused->qubits.push_back(target);
+        fused->iters = 0;
+        return 2 * len + 1;
+    }
+    return 0;
+}
+
+/**
+ * Matches 'cx b,a; ccx c,a,b; cx b,a' starting at the given gate, returns the number of matched gates (0 if there is no match)
+ */
+static size_t match_cswap(const fuse_ctx_t *ctx, size_t i, size_t end, gate_t *fused)
+{
+    const std::vector<gate_t>& gates = *ctx->gates;
+    if (i + 2 >= end || gates[i].type != GATE_CX || gates[i + 1].type != GATE_CCX || gates[i + 2].type != GATE_CX
+        || !valid_operands(ctx, gates[i]) || !valid_operands(ctx, gates[i + 1]) || gates[i].qubits != gates[i + 2].qubits) {
+        return 0;
+    }
+    long int b = gates[i].qubits[0];
+    long int a = gates[i].qubits[1];
+    const gate_t& g = gates[i + 1];
+    long int c;
+    if (g.qubits[2] != b || a == b) {
+        return 0;
+    }
+    else if (g.qubits[0] == a) {
+        c = g.qubits[1];
+    }
+    else if (g.qubits[1] == a) {
+        c = g.qubits[0];
+    }
+    else {
+        return 0;
+    }
+    if (c == a || c == b) {
+        return 0;
+    }
+
+    fused->type = GATE_CSWAP;
+    fused->qubits = {c, a, b};
+    fused->iters = 0;
+    return 3;
+}
+
+/**
+ * Fuses the gates in the range [begin, end) containing no loop boundaries
+ */
+static void fuse_range(fuse_ctx_t *ctx, size_t begin, size_t end)
+{
+    const std::vector<gate_t>& gates = *ctx->gates;
+    gate_t fused;
+    size_t i = begin;
+    while (i < end) {
+        size_t len;
+        if ((len = match_ladder(ctx, i, end, &fused)) > 0) {
+            ctx->stats.ladders++;
+        }
+        else if ((len = match_cswap(ctx, i, end, &fused)) > 0) {
+            ctx->stats.cswaps++;
+        }
+        else {
+            fused = gates[i];
+            len = 1;
+        }
+        i += len;
+
+        mark_dirty(ctx, fused);
+        if (!ctx->out->empty() && cancels(ctx->out->back(), fused)) {
+            ctx->out->pop_back();
+            ctx->stats.cancelled++;
+        }
+        else {
+            ctx->out->push_back(fused);
+        }
+    }
+}
+
+void fuse_circuit(circuit_t *circuit, fuse_stats_t *stats)
+{
+    const std::vector<gate_t> gates = circuit->gates;
+    std::vector<gate_t> out;
+    fuse_ctx_t ctx;
+    ctx.gates = &gates;
+    ctx.n_qubits = circuit->n_qubits;
+    ctx.clean.assign(std::max(circuit->n_qubits, 0), true);
+    ctx.out = &out;
+
+    size_t i = 0;
+    while (i < gates.size()) {
+        if (gates[i].type != GATE_LOOP) {
+            size_t j = i;
+            while (j < gates.size() && gates[j].type != GATE_LOOP) {
+                j++;
+            }
+            fuse_range(&ctx, i, j);
+            i = j;
+            continue;
+        }
+
+        size_t j = i + 1;
+        while (j < gates.size() && gates[j].type != GATE_LOOP_END) {
+            j++;
+        }
+        out.push_back(gates[i]);
+        // Every iteration starts with the qubits cleaned by the previous one, repeat until the clean qubits are stable
+        std::vector<bool> entry = ctx.clean;
+        size_t body_start = out.size();
+        fuse_stats_t stats_start = ctx.stats;
+        while (true) {
+            ctx.clean = entry;
+            out.resize(body_start);
+            ctx.stats = stats_start;
+            fuse_range(&ctx, i + 1, j);
+            if (ctx.clean == entry) {
+                break;
+            }
+            for (size_t q = 0; q < entry.size(); q++) {
+                entry[q] = entry[q] && ctx.clean[q];
+            }
+        }
+        if (j < gates.size()) {
+            out.push_back(gates[j]);
+        }
+        i = j + 1;
+    }
+
+    for (const gate_t& g : gates) {
+        stats->gates_before += (g.type != GATE_LOOP && g.type != GATE_LOOP_END);
+    }
+    for (const gate_t& g : out) {
+        stats->gates_after += (g.type != GATE_LOOP && g.type != GATE_LOOP_END);
+    }
+    stats->ladders += ctx.stats.ladders;
+    stats->cswaps += ctx.stats.cswaps;
+    stats->cancelled += ctx.stats.cancelled;
+    circuit->gates = out;
+}
+
+/* end of "fuse.c" */
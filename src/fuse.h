@@ -0,0 +1,33 @@
+#include <stddef.h>
+#include <vector>
+
+#include "sim.h"
+
+#ifndef FUSE_H
+#define FUSE_H
+
+typedef struct fuse_stats {      // Statistics of the gate fusion
+    size_t gates_before = 0;     // Number of gates before the fusion (loop bodies counted once)
+    size_t gates_after = 0;      // Number of gates after the fusion
+    unsigned ladders = 0;        // Toffoli ladders rewritten to a single mcx
+    unsigned cswaps = 0;         // cx, ccx, cx blocks rewritten to cswap
+    unsigned cancelled = 0;      // Pairs of adjacent identical controlled gates removed
+} fuse_stats_t;
+
+/**
+ * Rewrites blocks of gates of a parsed circuit into native multi-controlled operations:
+ *  - compute/uncompute Toffoli ladders 'ccx c0,c1,a0; ccx c2,a0,a1; ...; <middle>; <uncompute>' whose middle gate
+ *    (cx, ccx or mcx) is controlled by the last ancilla are rewritten to a single mcx, the ladder is only rewritten
+ *    if all its ancillas are provably |0> before it (so that the uncompute restores them)
+ *  - 'cx b,a; ccx c,a,b; cx b,a' is rewritten to 'cswap c,a,b'
+ *  - adjacent identical ccx, cswap and mcx gates cancel out
+ *
+ * @param circuit the circuit (rewritten in place)
+ *
+ * @param stats statistics of the fusion
+ *
+ */
+void fuse_circuit(circuit_t *circuit, fuse_stats_t *stats);
+
+#endif
+/* end of "fuse.h" */
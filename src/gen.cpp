@@ -0,0 +1,373 @@
+#include <math.h>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "gen.h"
+
+#define GEN_LINE_MAX_LEN 64   // Max. length of a single generated gate (except mcx)
+#define RANDOM_DEPTH 10       // Default number of layers of the random circuits
+
+/**
+ * Appends a single-qubit gate to the circuit
+ */
+static void add_gate(std::string *s, const char *gate, int q)
+{
+    char line[GEN_LINE_MAX_LEN];
+    snprintf(line, sizeof(line), "%s q[%d];\n", gate, q);
+    *s += line;
+}
+
+/**
+ * Appends a two-qubit gate to the circuit
+ */
+static void add_gate(std::string *s, const char *gate, int q1, int q2)
+{
+    char line[GEN_LINE_MAX_LEN];
+    snprintf(line, sizeof(line), "%s q[%d], q[%d];\n", gate, q1, q2);
+    *s += line;
+}
+
+/**
+ * Appends a three-qubit gate to the circuit
+ */
+static void add_gate(std::string *s, const char *gate, int q1, int q2, int q3)
+{
+    char line[GEN_LINE_MAX_LEN];
+    snprintf(line, sizeof(line), "%s q[%d], q[%d], q[%d];\n", gate, q1, q2, q3);
+    *s += line;
+}
+
+/**
+ * Appends a multi-controlled NOT gate to the circuit (the target is the last qubit)
+ */
+static void add_mcx(std::string *s, const std::vector<int>& qubits)
+{
+    char line[GEN_LINE_MAX_LEN];
+    *s += "mcx";
+    for (size_t i = 0; i < qubits.size(); i++) {
+        snprintf(line, sizeof(line), "%s q[%d]", (i == 0) ? "" : ",", qubits[i]);
+        *s += line;
+    }
+    *s += ";\n";
+}
+
+/**
+ * Sets the given qubit to one in the expected basis state
+ */
+static void set_expected(gen_circ_t *circ, int q)
+{
+    circ->expected[circ->expected.size() - 1 - q] = '1';
+}
+
+/**
+ * GHZ state preparation
+ */
+static void gen_ghz(int n, int /* depth */, unsigned /* seed */, gen_circ_t *circ)
+{
+    add_gate(&circ->qasm, "h", 0);
+    for (int i = 0; i + 1 < n; i++) {
+        add_gate(&circ->qasm, "cx", i, i + 1);
+    }
+}
+
+/**
+ * Controlled S gate decomposed into Clifford+T gates
+ */
+static void add_cs(std::string *s, int c, int t)
+{
+    add_gate(s, "t", c);
+    add_gate(s, "t", t);
+    add_gate(s, "cx", c, t);
+    // T^dagger = Z S T
+    add_gate(s, "z", t);
+    add_gate(s, "s", t);
+    add_gate(s, "t", t);
+    add_gate(s, "cx", c, t);
+}
+
+/**
+ * Approximate QFT of a basis state (only the controlled rotations by pi and pi/2 are expressible in Clifford+T,
+ * the finer rotations are omitted)
+ */
+static void gen_qft(int n, int /* depth */, unsigned /* seed */, gen_circ_t *circ)
+{
+    // non-trivial input state
+    for (int i = 0; i < n; i += 2) {
+        add_gate(&circ->qasm, "x", i);
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        add_gate(&circ->qasm, "h", i);
+        if (i >= 1) {
+            add_cs(&circ->qasm, i - 1, i);
+        }
+    }
+    // every basis state has the probability 2^-n, the fingerprint is the all-zero state
+}
+
+/**
+ * Grover search for the all-ones state on n-1 qubits with a phase oracle using the last qubit,
+ * depth is the number of iterations (0 for the optimal number)
+ */
+static void gen_grover(int n, int depth, unsigned /* seed */, gen_circ_t *circ)
+{
+    int data = n - 1;
+    int anc = n - 1;
+    int iters = (depth > 0) ? depth : (int)floor(M_PI / 4 * sqrt(pow(2, data)));
+    if (iters < 1) {
+        iters = 1;
+    }
+
+    std::vector<int> oracle;
+    std::vector<int> diffusion;
+    for (int i = 0; i < data; i++) {
+        oracle.push_back(i);
+        diffusion.push_back(i);
+    }
+    oracle.push_back(anc);
+
+    add_gate(&circ->qasm, "x", anc);
+    add_gate(&circ->qasm, "h", anc);
+    for (int i = 0; i < data; i++) {
+        add_gate(&circ->qasm, "h", i);
+    }
+
+    char line[GEN_LINE_MAX_LEN];
+    snprintf(line, sizeof(line), "for i in [0:%d] {\n", iters - 1);
+    circ->qasm += line;
+    add_mcx(&circ->qasm, oracle);
+    for (int i = 0; i < data; i++) {
+        add_gate(&circ->qasm, "h", i);
+        add_gate(&circ->qasm, "x", i);
+    }
+    add_gate(&circ->qasm, "h", data - 1);
+    add_mcx(&circ->qasm, diffusion);
+    add_gate(&circ->qasm, "h", data - 1);
+    for (int i = 0; i < data; i++) {
+        add_gate(&circ->qasm, "x", i);
+        add_gate(&circ->qasm, "h", i);
+    }
+    circ->qasm += "}\n";
+
+    // the ancilla stays in |->, uncompute it to get a deterministic fingerprint
+    add_gate(&circ->qasm, "h", anc);
+    add_gate(&circ->qasm, "x", anc);
+    for (int i = 0; i < data; i++) {
+        set_expected(circ, i);
+    }
+}
+
+/**
+ * Bernstein-Vazirani with a random secret on n-1 qubits, the last qubit is the oracle target
+ */
+static void gen_bv(int n, int /* depth */, unsigned seed, gen_circ_t *circ)
+{
+    std::mt19937 gen(seed);
+    int anc = n - 1;
+
+    add_gate(&circ->qasm, "x", anc);
+    for (int i = 0; i < n; i++) {
+        add_gate(&circ->qasm, "h", i);
+    }
+    for (int i = 0; i < anc; i++) {
+        if (gen() % 2) {
+            add_gate(&circ->qasm, "cx", i, anc);
+            set_expected(circ, i);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        add_gate(&circ->qasm, "h", i);
+    }
+    set_expected(circ, anc);
+}
+
+/**
+ * Random Clifford+T circuit, depth is the number of layers (single-qubit gates followed by random CNOTs)
+ */
+static void gen_random(int n, int depth, unsigned seed, gen_circ_t *circ)
+{
+    static const char *gates[] = {"h", "s", "t", "x", "z", "rx(pi/2)", "ry(pi/2)"};
+    std::mt19937 gen(seed);
+    std::vector<int> qubits(n);
+    for (int i = 0; i < n; i++) {
+        qubits[i] = i;
+    }
+
+    int layers = (depth > 0) ? depth : RANDOM_DEPTH;
+    for (int l = 0; l < layers; l++) {
+        for (int i = 0; i < n; i++) {
+            add_gate(&circ->qasm, gates[gen() % (sizeof(gates) / sizeof(gates[0]))], i);
+        }
+        std::shuffle(qubits.begin(), qubits.end(), gen);
+        for (int i = 0; i + 1 < n; i += 2) {
+            if (gen() % 2) {
+                add_gate(&circ->qasm, "cx", qubits[i], qubits[i + 1]);
+            }
+        }
+    }
+    // the fingerprint is the all-zero state
+}
+
+/**
+ * Cuccaro ripple-carry adder b += a of two (n-2)/2 bit numbers (the carry-in and the carry-out are the first and the last qubit)
+ */
+static void gen_adder(int n, int /* depth */, unsigned /* seed */, gen_circ_t *circ)
+{
+    int m = (n - 2) / 2;
+    int cin = 0;
+    int z = 2 * m + 1;
+    auto a = [](int i) { return 1 + i; };
+    auto b = [m](int i) { return 1 + m + i; };
+
+    // a = ...0101, b = ...1111
+    unsigned long long av = 0, bv = 0;
+    for (int i = 0; i < m; i++) {
+        if (i % 2 == 0) {
+            add_gate(&circ->qasm, "x", a(i));
+            av |= 1ULL << (i % 64);
+        }
+        add_gate(&circ->qasm, "x", b(i));
+        bv |= 1ULL << (i % 64);
+    }
+
+    // MAJ(x, y, w): cx w,y; cx w,x; ccx x,y,w
+    auto maj = [circ](int x, int y, int w) {
+        add_gate(&circ->qasm, "cx", w, y);
+        add_gate(&circ->qasm, "cx", w, x);
+        add_gate(&circ->qasm, "ccx", x, y, w);
+    };
+    // UMA(x, y, w): ccx x,y,w; cx w,x; cx x,y
+    auto uma = [circ](int x, int y, int w) {
+        add_gate(&circ->qasm, "ccx", x, y, w);
+        add_gate(&circ->qasm, "cx", w, x);
+        add_gate(&circ->qasm, "cx", x, y);
+    };
+
+    maj(cin, b(0), a(0));
+    for (int i = 1; i < m; i++) {
+        maj(a(i - 1), b(i), a(i));
+    }
+    add_gate(&circ->qasm, "cx", a(m - 1), z);
+    for (int i = m - 1; i >= 1; i--) {
+        uma(a(i - 1), b(i), a(i));
+    }
+    uma(cin, b(0), a(0));
+
+    // Expected result: a unchanged, b = a + b, z = carry (exact for up to 63 bits)
+    if (m < 64) {
+        unsigned long long sum = av + bv;
+        for (int i = 0; i < m; i++) {
+            if ((av >> i) & 1) {
+                set_expected(circ, a(i));
+            }
+            if ((sum >> i) & 1) {
+                set_expected(circ, b(i));
+            }
+        }
+        if ((sum >> m) & 1) {
+            set_expected(circ, z);
+        }
+    }
+}
+
+/**
+ * Multi-controlled NOT on (n+1)/2 controls built as a compute/uncompute ladder of Toffoli gates with ancillas
+ * (if native is true, a single mcx gate is used instead)
+ */
+static void gen_mcx_common(int n, bool native, gen_circ_t *circ)
+{
+    int m = (n + 1) / 2;          // controls
+    int t = n - 1;                // target
+    auto c = [](int i) { return i; };
+    auto anc = [m](int i) { return m + i; };
+
+    for (int i = 0; i < m; i++) {
+        add_gate(&circ->qasm, "x", c(i));
+        set_expected(circ, c(i));
+    }
+    set_expected(circ, t);
+
+    if (native) {
+        std::vector<int> qubits;
+        for (int i = 0; i < m; i++) {
+            qubits.push_back(c(i));
+        }
+        qubits.push_back(t);
+        add_mcx(&circ->qasm, qubits);
+        return;
+    }
+
+    // compute
+    add_gate(&circ->qasm, "ccx", c(0), c(1), (m == 2) ? t : anc(0));
+    for (int i = 2; i < m; i++) {
+        add_gate(&circ->qasm, "ccx", c(i), anc(i - 2), (i == m - 1) ? t : anc(i - 1));
+    }
+    // uncompute
+    for (int i = m - 2; i >= 2; i--) {
+        add_gate(&circ->qasm, "ccx", c(i), anc(i - 2), anc(i - 1));
+    }
+    if (m > 2) {
+        add_gate(&circ->qasm, "ccx", c(0), c(1), anc(0));
+    }
+}
+
+static void gen_toffoli(int n, int /* depth */, unsigned /* seed */, gen_circ_t *circ)
+{
+    gen_mcx_common(n, false, circ);
+}
+
+static void gen_mcx(int n, int /* depth */, unsigned /* seed */, gen_circ_t *circ)
+{
+    gen_mcx_common(n, true, circ);
+}
+
+/** Supported families. */
+static const gen_family_t families[] = {
+    {"ghz",     2, false, gen_ghz},
+    {"qft",     2, false, gen_qft},
+    {"grover",  3, true,  gen_grover},
+    {"bv",      2, false, gen_bv},
+    {"random",  2, true,  gen_random},
+    {"adder",   4, false, gen_adder},
+    {"toffoli", 3, false, gen_toffoli},
+    {"mcx",     3, false, gen_mcx},
+    {NULL,      0, false, NULL}
+};
+
+const gen_family_t* gen_get_family(const char *name)
+{
+    for (const gen_family_t *f = families; f->name != NULL; f++) {
+        if (strcmp(f->name, name) == 0) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+const gen_family_t* gen_families()
+{
+    return families;
+}
+
+void gen_circuit(const gen_family_t *family, int n, int depth, unsigned seed, bool measure, gen_circ_t *circ)
+{
+    if (n < family->min_qubits) {
+        error_exit("Family '%s' requires at least %d qubits.\n", family->name, family->min_qubits);
+    }
+
+    char line[GEN_LINE_MAX_LEN];
+    snprintf(line, sizeof(line), "OPENQASM 2.0;\ninclude \"qelib1.inc\";\nqreg q[%d];\ncreg c[%d];\n", n, n);
+    circ->qasm = line;
+    circ->expected.assign(n, '0');
+
+    family->generate(n, depth, seed, circ);
+
+    if (measure) {
+        for (int i = 0; i < n; i++) {
+            snprintf(line, sizeof(line), "measure q[%d] -> c[%d];\n", i, i);
+            circ->qasm += line;
+        }
+    }
+}
+
+/* end of "gen.c" */
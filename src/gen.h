@@ -0,0 +1,50 @@
+#include <stdbool.h>
+#include <string>
+
+#include "error.h"
+
+#ifndef GEN_H
+#define GEN_H
+
+typedef struct gen_circ {        // Generated benchmark circuit
+    std::string qasm;            // The circuit in the QASM format
+    std::string expected;        // Basis state whose probability is used as the result fingerprint (qubit 0 is the last bit)
+} gen_circ_t;
+
+typedef struct gen_family {      // Parameterized family of benchmark circuits
+    const char *name;
+    int min_qubits;              // Min. supported number of qubits
+    bool uses_depth;             // True if the depth parameter changes the circuit
+    void (*generate)(int n, int depth, unsigned seed, gen_circ_t *circ);
+} gen_family_t;
+
+/**
+ * Returns the family with the given name, NULL if there is no such family
+ */
+const gen_family_t* gen_get_family(const char *name);
+
+/**
+ * Returns all supported families (terminated by an item with NULL name)
+ */
+const gen_family_t* gen_families();
+
+/**
+ * Generates a circuit of the given family
+ *
+ * @param family the circuit family
+ *
+ * @param n total number of qubits (including ancillas)
+ *
+ * @param depth family specific depth (number of layers or iterations, 0 for the family's default)
+ *
+ * @param seed seed for the randomized families
+ *
+ * @param measure true if all qubits should be measured at the end of the circuit
+ *
+ * @param circ the generated circuit
+ *
+ */
+void gen_circuit(const gen_family_t *family, int n, int depth, unsigned seed, bool measure, gen_circ_t *circ);
+
+#endif
+/* end of "gen.h" */
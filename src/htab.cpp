@@ -75,7 +75,7 @@ void htab_m_clear(htab_t *t)
 
 void htab_m_free(htab_t *t)
 {
-    htab_clear(t, htab_m_del_item);
+    htab_free(t, htab_m_del_item);
 }
 
 /**
@@ -133,13 +133,18 @@ static void htab_resize(htab_t *t, size_t newn, size_t (*hash_func)(htab_key_t))
 }
 
 void htab_m_lookup_add(htab_t *t, htab_m_key_t key)
+{
+    htab_m_lookup_add_count(t, key, 1);
+}
+
+void htab_m_lookup_add_count(htab_t *t, htab_m_key_t key, htab_value_t count)
 {
     htab_item_t *item = t->arr_ptr[htab_m_hash_func(key) % t->arr_size];
 
     // find the item
     while (item != NULL) {
         if (strcmp((const char*)(item->data.key),key) == 0) {
-            item->data.value++;
+            item->data.value += count;
             return;
         }
         item = item->next;
@@ -149,7 +154,7 @@ void htab_m_lookup_add(htab_t *t, htab_m_key_t key)
     // item init
     htab_m_key_t key_temp = (htab_m_key_t)my_malloc(sizeof(char) * (strlen(key) + 1));
     item->data.key = (htab_key_t)(strcpy(key_temp, key));
-    item->data.value = 1;
+    item->data.value = count;
     item->next = NULL;
 
     // insert new item into the table
@@ -171,21 +176,14 @@ void htab_m_lookup_add(htab_t *t, htab_m_key_t key)
     }
 }
 
-void htab_m_print_all(htab_t *t, FILE *output)
+void htab_m_for_each(htab_t *t, void (*func)(htab_m_key_t key, htab_value_t value, void *data), void *data)
 {
-    fprintf(output, "Sampled results:\n");
-
     htab_item_t *curr;
     for (size_t i = 0; i < t->arr_size; i++) {
         curr = t->arr_ptr[i];
 
         while (curr != NULL) {
-            fprintf(output,"    \'");
-            // key stored as LSBF
-            for(int i=(strlen((const char*)(curr->data.key))-1); i >= 0 ;i--) {
-                putc(htab_m_get_key(curr)[i], output);
-            }
-            fprintf(output,"\'    %d\n", curr->data.value);
+            func(htab_m_get_key(curr), curr->data.value, data);
             curr = curr->next;
         }
     }
@@ -17,7 +17,7 @@ typedef struct htab {            // Hash table
 
 typedef void* htab_key_t;            // Universal hash table data key type
 typedef char* htab_m_key_t;          // Key type for measure hash table
-typedef unsigned htab_value_t;       // Universal hash table data value type
+typedef unsigned long htab_value_t;  // Universal hash table data value type
 
 typedef struct htab_data {       // Data in a hash table item
     htab_key_t key;
@@ -43,9 +43,14 @@ htab_t* htab_init(size_t n);
 void htab_m_lookup_add(htab_t *t, htab_m_key_t key);
 
 /**
- * Prints all hash table items to the given stream (used for measurement output)
+ * Adds the item with the given string key and value to the table, else (if already exists) increments its value by the given count
  */
-void htab_m_print_all(htab_t *t, FILE *output);
+void htab_m_lookup_add_count(htab_t *t, htab_m_key_t key, htab_value_t count);
+
+/**
+ * Calls the given function for every measure table item (the keys are stored as LSBF)
+ */
+void htab_m_for_each(htab_t *t, void (*func)(htab_m_key_t key, htab_value_t value, void *data), void *data);
 
 /**
  * Deletes and deallocates all measure table items
@@ -0,0 +1,298 @@
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio_ext.h>
+#include <sys/stat.h>
+
+#include "input.h"
+
+#ifdef WITH_GZIP
+#include <zlib.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
+/**
+ * Supported compression formats
+ */
+#define MAGIC_LEN 4 // Number of bytes needed to detect the compression format
+
+typedef enum compression {
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+} compression_t;
+
+typedef struct peek_cookie {     // Stream returning the bytes peeked from a pipe before the rest of the pipe
+    FILE *in;
+    unsigned char buf[MAGIC_LEN];
+    size_t len;
+    size_t pos;                  // Number of the peeked bytes already returned
+} peek_cookie_t;
+
+static ssize_t peek_read(void *cookie, char *buf, size_t size)
+{
+    peek_cookie_t *pc = (peek_cookie_t*)cookie;
+    if (pc->pos < pc->len) {
+        size_t n = (pc->len - pc->pos < size) ? pc->len - pc->pos : size;
+        memcpy(buf, pc->buf + pc->pos, n);
+        pc->pos += n;
+        return n;
+    }
+    size_t n = fread(buf, 1, size, pc->in);
+    return (n == 0 && ferror(pc->in)) ? -1 : (ssize_t)n;
+}
+
+static int peek_close(void *cookie)
+{
+    peek_cookie_t *pc = (peek_cookie_t*)cookie;
+    int ret = fclose(pc->in);
+    free(pc);
+    return ret;
+}
+
+/**
+ * Reads the magic bytes of a file that cannot be rewound (e.g. a pipe) and replaces the stream by a stream
+ * returning the read bytes first
+ */
+static size_t peek_magic(FILE **f, unsigned char *magic)
+{
+    // nothing has been read by the stream yet, so the bytes are read directly from the descriptor
+    size_t len = 0;
+    while (len < MAGIC_LEN) {
+        ssize_t n = read(fileno(*f), magic + len, MAGIC_LEN - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (n <= 0) {
+            break; // a read error is reported again by the following reads
+        }
+        len += n;
+    }
+
+    peek_cookie_t *pc = (peek_cookie_t*)my_malloc(sizeof(peek_cookie_t));
+    pc->in = *f;
+    memcpy(pc->buf, magic, len);
+    pc->len = len;
+    pc->pos = 0;
+
+    cookie_io_functions_t funcs = {peek_read, NULL, NULL, peek_close};
+    *f = fopencookie(pc, "r", funcs);
+    if (*f == NULL) {
+        peek_close(pc);
+    }
+    return len;
+}
+
+/**
+ * Detects the compression format from the magic bytes at the start of the file. A regular file is rewound,
+ * any other file is replaced by a stream returning the magic bytes first (NULL on failure).
+ */
+static compression_t detect_compression(FILE **f)
+{
+    unsigned char magic[MAGIC_LEN] = {0};
+    size_t len;
+    struct stat sb;
+
+    if (fstat(fileno(*f), &sb) == 0 && S_ISREG(sb.st_mode)) {
+        len = fread(magic, 1, MAGIC_LEN, *f);
+        if (fseek(*f, 0, SEEK_SET) != 0) {
+            io_error_exit("Could not read the input file.\n");
+        }
+    }
+    else {
+        len = peek_magic(f, magic);
+        if (*f == NULL) {
+            return COMPRESSION_NONE;
+        }
+    }
+
+    if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return COMPRESSION_GZIP;
+    }
+    else if (len >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+#ifdef WITH_GZIP
+typedef struct gzip_cookie {     // State of a gzip decompressed stream
+    FILE *in;                    // The compressed file
+    z_stream zs;
+    unsigned char *in_buf;       // The current block of the compressed file
+    bool member_end;             // True if the last decompressed member has been finished
+} gzip_cookie_t;
+
+static ssize_t gzip_read(void *cookie, char *buf, size_t size)
+{
+    gzip_cookie_t *gc = (gzip_cookie_t*)cookie;
+    uInt out_size = (size > UINT_MAX) ? UINT_MAX : size;
+    gc->zs.next_out = (Bytef*)buf;
+    gc->zs.avail_out = out_size;
+
+    while (gc->zs.avail_out == out_size) {
+        if (gc->zs.avail_in == 0) {
+            gc->zs.avail_in = fread(gc->in_buf, 1, INPUT_BLOCK_SIZE, gc->in);
+            gc->zs.next_in = gc->in_buf;
+            if (gc->zs.avail_in == 0) {
+                // a truncated member is an error
+                return (ferror(gc->in) || !gc->member_end) ? -1 : 0;
+            }
+        }
+        if (gc->member_end) {
+            inflateReset(&gc->zs); // the next member follows
+            gc->member_end = false;
+        }
+        int ret = inflate(&gc->zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            gc->member_end = true;
+        }
+        else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            return -1;
+        }
+    }
+    return out_size - gc->zs.avail_out;
+}
+
+static int gzip_close(void *cookie)
+{
+    gzip_cookie_t *gc = (gzip_cookie_t*)cookie;
+    int ret = fclose(gc->in);
+    inflateEnd(&gc->zs);
+    free(gc->in_buf);
+    free(gc);
+    return ret;
+}
+
+/**
+ * Opens a gzip compressed file (concatenated gzip members are read as a single stream)
+ */
+static FILE* gzip_open(FILE *in)
+{
+    gzip_cookie_t *gc = (gzip_cookie_t*)my_malloc(sizeof(gzip_cookie_t));
+    gc->in = in;
+    memset(&gc->zs, 0, sizeof(z_stream));
+    if (inflateInit2(&gc->zs, 16 + MAX_WBITS) != Z_OK) { // gzip header only
+        error_exit("Could not initialize the gzip decompression.\n");
+    }
+    gc->in_buf = (unsigned char*)my_malloc(INPUT_BLOCK_SIZE);
+    gc->member_end = false;
+
+    cookie_io_functions_t funcs = {gzip_read, NULL, NULL, gzip_close};
+    FILE *f = fopencookie(gc, "r", funcs);
+    if (f == NULL) {
+        gzip_close(gc);
+    }
+    return f;
+}
+#endif
+
+#ifdef WITH_ZSTD
+typedef struct zstd_cookie {     // State of a zstd decompressed stream
+    FILE *in;                    // The compressed file
+    ZSTD_DStream *ds;
+    ZSTD_inBuffer in_buf;        // The current block of the compressed file
+    bool frame_end;              // True if the last decompressed frame has been finished
+    bool flush;                  // True if the decoder may hold decompressed data not returned yet
+} zstd_cookie_t;
+
+static ssize_t zstd_read(void *cookie, char *buf, size_t size)
+{
+    zstd_cookie_t *zc = (zstd_cookie_t*)cookie;
+    ZSTD_outBuffer out_buf = {buf, size, 0};
+
+    while (out_buf.pos == 0) {
+        if (zc->in_buf.pos == zc->in_buf.size && !zc->flush) {
+            zc->in_buf.size = fread((void*)zc->in_buf.src, 1, INPUT_BLOCK_SIZE, zc->in);
+            zc->in_buf.pos = 0;
+            if (zc->in_buf.size == 0) {
+                // a truncated frame is an error
+                return (ferror(zc->in) || !zc->frame_end) ? -1 : 0;
+            }
+        }
+        size_t ret = ZSTD_decompressStream(zc->ds, &out_buf, &zc->in_buf);
+        if (ZSTD_isError(ret)) {
+            return -1;
+        }
+        zc->frame_end = (ret == 0);
+        zc->flush = (out_buf.pos == out_buf.size);
+    }
+    return out_buf.pos;
+}
+
+static int zstd_close(void *cookie)
+{
+    zstd_cookie_t *zc = (zstd_cookie_t*)cookie;
+    int ret = fclose(zc->in);
+    ZSTD_freeDStream(zc->ds);
+    free((void*)zc->in_buf.src);
+    free(zc);
+    return ret;
+}
+
+/**
+ * Opens a zstd compressed file (concatenated frames are read as a single stream)
+ */
+static FILE* zstd_open(FILE *in)
+{
+    zstd_cookie_t *zc = (zstd_cookie_t*)my_malloc(sizeof(zstd_cookie_t));
+    zc->in = in;
+    zc->ds = ZSTD_createDStream();
+    if (zc->ds == NULL) {
+        error_exit("Could not initialize the zstd decompression.\n");
+    }
+    ZSTD_initDStream(zc->ds);
+    zc->in_buf.src = my_malloc(INPUT_BLOCK_SIZE);
+    zc->in_buf.size = 0;
+    zc->in_buf.pos = 0;
+    zc->frame_end = true;
+    zc->flush = false;
+
+    cookie_io_functions_t funcs = {zstd_read, NULL, NULL, zstd_close};
+    FILE *f = fopencookie(zc, "r", funcs);
+    if (f == NULL) {
+        zstd_close(zc);
+    }
+    return f;
+}
+#endif
+
+FILE* input_open(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    FILE *res = NULL;
+    compression_t compression = detect_compression(&f);
+    if (compression == COMPRESSION_NONE) {
+        res = f;
+    }
+    else if (compression == COMPRESSION_GZIP) {
+        #ifdef WITH_GZIP
+            res = gzip_open(f);
+        #else
+            fclose(f);
+            error_exit("Input file '%s' is gzip compressed, but the gzip support is not enabled (build with WITH_GZIP=1).\n", path);
+        #endif
+    }
+    else {
+        #ifdef WITH_ZSTD
+            res = zstd_open(f);
+        #else
+            fclose(f);
+            error_exit("Input file '%s' is zstd compressed, but the zstd support is not enabled (build with WITH_ZSTD=1).\n", path);
+        #endif
+    }
+
+    if (res != NULL) {
+        // the parser reads by single characters, locking the stream on every read would dominate the parsing
+        __fsetlocking(res, FSETLOCKING_BYCALLER);
+    }
+    return res;
+}
+
+/* end of "input.c" */
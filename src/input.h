@@ -0,0 +1,24 @@
+#include <stdio.h>
+
+#include "error.h"
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#define INPUT_BLOCK_SIZE (1 << 20) // Size of the blocks read from a compressed file
+
+/**
+ * Opens a circuit file for reading. Compressed files (gzip, zstd) are detected by their magic bytes and decompressed
+ * while being read (in blocks, with bounded memory and without temporary files). The detection does not seek,
+ * so pipes and FIFOs can be read as well. The returned stream may not be seekable and it must be used by a single
+ * thread only.
+ *
+ * @param path path to the file
+ *
+ * @return the opened stream (closed by fclose()), NULL if the file could not be opened
+ *
+ */
+FILE* input_open(const char *path);
+
+#endif
+/* end of "input.h" */
@@ -1,12 +1,16 @@
 #include <stdio.h>
-#include <getopt.h>
 #include <time.h>
-#include <sys/resource.h>
-#include "sim.h"
+#include <getopt.h>
+#include <unistd.h>
+#include "quasimodosim.h"
 #include "error.h"
+#include "server.h"
+#include "sweep.h"
+#include "bench.h"
+#include "input.h"
+#include "cache.h"
 
-#include "quantum_circuit.h"
-#include "quantum_circuit_factory.h"
+#define DEFAULT_MAX_SUPPORT 4096
 
 #define HELP_MSG \
 " Usage: sim [options] \n\
@@ -14,144 +18,553 @@
  Options with no argument:\n\
  --help,     -h          show this message\n\
  --info,     -i          measure the simulation runtime and peak memory usage\n\
+ --sweep                 simulate all circuit files given as the remaining arguments, the common\n\
+                         prefixes of the circuits are simulated only once\n\
+ --fuse                  parse the whole circuit first and fuse compute/uncompute Toffoli ladders into\n\
+                         mcx gates and 'cx b,a; ccx c,a,b; cx b,a' into cswap gates, with --bench\n\
+                         every run is repeated with the fusion and the gates saved are reported\n\
+ --bench                 run the synthetic benchmark suite: every circuit family on every backend for\n\
+                         the given ranges of qubits and depths, the scaling curves are printed as CSV\n\
+ --cache-stats           print the hit/miss statistics and the size of the result cache given by --cache\n\
  \n\
  Options with a required argument:\n\
  --type,     -t          specify the backend type: 'CFLOBDD', 'WCFLOBDD','BDD','WBDD' (default 'CFLOBDD')\n\
  --file,     -f          specify the input QASM file (default STDIN)\n\
  --nsamples, -n          specify the number of samples used for measurement (default 1024)\n\
+ --serve                 run as a daemon accepting jobs on the given unix socket, all backends\n\
+                         are initialized once and every job runs in a forked copy of the daemon\n\
+ --submit                submit the job given by the other options to the daemon on the given\n\
+                         unix socket and print its output\n\
+ --max-jobs              max. number of concurrently running daemon jobs (default number of CPUs)\n\
+ --job-timeout           max. runtime of a daemon job in seconds (default 0 - no limit)\n\
+ --job-mem               max. memory (address space) of a daemon job in MB (default 0 - no limit)\n\
+ --amplitude             compute the probability (squared amplitude magnitude) of the given basis state\n\
+                         without sampling, e.g. '0101' (the last bit is qubit 0), can be used repeatedly\n\
+ --expect                compute the expectation value of the given Pauli string without sampling,\n\
+                         e.g. 'ZZIIX' (the last operator acts on qubit 0), can be used repeatedly\n\
+ --generate              print a circuit of the given family: 'ghz', 'qft', 'grover', 'bv', 'random',\n\
+                         'adder', 'toffoli', 'mcx' (sized by --qubits and --depth, measured with -m)\n\
+ --qubits                number of qubits or range 'start:end[:step]' for --bench (default 4:16:4)\n\
+ --depth                 family specific depth or range 'start:end[:step]' for --bench, i.e. layers\n\
+                         of 'random' and iterations of 'grover' (default 0 - the family's default)\n\
+ --families              comma separated benchmarked families (default all)\n\
+ --backends              comma separated benchmarked backends (default all)\n\
+ --seed                  seed of the randomized circuit families and of the multinomial sampling\n\
+                         (default 0 for the families, random for the sampling)\n\
+ --bench-out             save the benchmark results as JSON to the given file\n\
+ --baseline              compare the benchmark results against the given JSON file and fail\n\
+                         on a regression, --job-timeout and --job-mem limit every run\n\
+ --tolerance             allowed relative slowdown and memory growth against the baseline (default 0.25)\n\
+ --cache                 look up the result in the given cache directory before simulating and store it\n\
+                         after a miss, the key is a hash of the parsed gates and of the options affecting\n\
+                         the result (the whole circuit is parsed before the simulation), measured runs\n\
+                         are only cached with --seed (random samples would be reused otherwise)\n\
+ --cache-size            max. size of the result cache in MB, the least recently used results are removed\n\
+                         (default 256, 0 - no limit)\n\
  \n\
  Options with an optional argument:\n\
  --measure,  -m          perform the measure operations encountered in the circuit, \n\
-                         optional arg specifies the file for saving the measurement result (default STDOUT)"
+                         optional arg specifies the file for saving the measurement result (default STDOUT)\n\
+ --multinomial           enumerate the measurement outcomes with a non-negligible probability and draw all\n\
+                         samples by a single multinomial draw (time independent of the number of samples),\n\
+                         optional arg specifies the max. number of outcomes (default 4096), for more\n\
+                         outcomes every shot is sampled"
+
+/** Values of the options with no short form. */
+enum long_opt {
+    OPT_SERVE = 256,
+    OPT_SUBMIT,
+    OPT_MAX_JOBS,
+    OPT_JOB_TIMEOUT,
+    OPT_JOB_MEM,
+    OPT_AMPLITUDE,
+    OPT_EXPECT,
+    OPT_SWEEP,
+    OPT_GENERATE,
+    OPT_BENCH,
+    OPT_QUBITS,
+    OPT_DEPTH,
+    OPT_FAMILIES,
+    OPT_BACKENDS,
+    OPT_SEED,
+    OPT_BENCH_OUT,
+    OPT_BASELINE,
+    OPT_TOLERANCE,
+    OPT_FUSE,
+    OPT_MULTINOMIAL,
+    OPT_CACHE,
+    OPT_CACHE_SIZE,
+    OPT_CACHE_STATS,
+};
+
+typedef struct sim_opts {        // Program options
+    const char *in_path;         // Input file (NULL for the default input)
+    const char *measure_path;    // Measurement output file (NULL for STDOUT)
+    bool opt_info;
+    bool opt_sweep;
+    std::vector<const char*> circuits; // Circuit files given as the remaining arguments (for the sweep)
+    qsim_opts_t sim;             // Options of the simulation itself
+    const char *serve_path;      // Daemon socket when running as a daemon
+    const char *submit_path;     // Daemon socket when submitting a job
+    server_limits_t limits;
+    const char *gen_family;      // Family of the generated circuit (NULL if not generating)
+    bool opt_bench;
+    bench_opts_t bench;          // Options of the benchmark suite (also sizes the generated circuit)
+    const char *cache_dir;       // Result cache directory (NULL if the results are not cached)
+    unsigned long cache_size;    // Max. size of the result cache in MB (0 for no limit)
+    bool opt_cache_stats;
+} sim_opts_t;
+
+/** Short options of the program (the long ones are below). */
+#define SHORT_OPTS "hit:f:m::n:"
+
+static struct option long_options[] = {
+    {"help",        no_argument,        0, 'h'},
+    {"info",        no_argument,        0, 'i'},
+    {"type",        required_argument,  0, 't'},
+    {"file",        required_argument,  0, 'f'},
+    {"measure",     optional_argument,  0, 'm'},
+    {"nsamples",    required_argument,  0, 'n'},
+    {"serve",       required_argument,  0, OPT_SERVE},
+    {"submit",      required_argument,  0, OPT_SUBMIT},
+    {"max-jobs",    required_argument,  0, OPT_MAX_JOBS},
+    {"job-timeout", required_argument,  0, OPT_JOB_TIMEOUT},
+    {"job-mem",     required_argument,  0, OPT_JOB_MEM},
+    {"amplitude",   required_argument,  0, OPT_AMPLITUDE},
+    {"expect",      required_argument,  0, OPT_EXPECT},
+    {"sweep",       no_argument,        0, OPT_SWEEP},
+    {"generate",    required_argument,  0, OPT_GENERATE},
+    {"bench",       no_argument,        0, OPT_BENCH},
+    {"qubits",      required_argument,  0, OPT_QUBITS},
+    {"depth",       required_argument,  0, OPT_DEPTH},
+    {"families",    required_argument,  0, OPT_FAMILIES},
+    {"backends",    required_argument,  0, OPT_BACKENDS},
+    {"seed",        required_argument,  0, OPT_SEED},
+    {"bench-out",   required_argument,  0, OPT_BENCH_OUT},
+    {"baseline",    required_argument,  0, OPT_BASELINE},
+    {"tolerance",   required_argument,  0, OPT_TOLERANCE},
+    {"fuse",        no_argument,        0, OPT_FUSE},
+    {"multinomial", optional_argument,  0, OPT_MULTINOMIAL},
+    {"cache",       required_argument,  0, OPT_CACHE},
+    {"cache-size",  required_argument,  0, OPT_CACHE_SIZE},
+    {"cache-stats", no_argument,        0, OPT_CACHE_STATS},
+    {0, 0, 0, 0}
+};
+
+/** Simulator session, its backends are shared by all jobs of the daemon (never destroyed, freed with the process). */
+static QuasimodoSim *simulator = new QuasimodoSim();
 
 /**
- * Returns the peak physical memory usage of the process in kilobytes. For an unsupported OS returns -1.
+ * Parses a number option argument
  */
-static long get_peak_mem()
+static unsigned long parse_opt_num(const char *arg, const char *what)
 {
-    long peak = 0;
-    #if defined(__unix__) || defined(__APPLE__)
-        struct rusage rs_usage;
-        if (getrusage(RUSAGE_SELF, &rs_usage) == 0) {
-            peak = rs_usage.ru_maxrss;
-        }
-    #else
-        // Unknown OS
-        peak = -1;
-    #endif
-    return peak;
+    char *endptr;
+    unsigned long n = strtoul(arg, &endptr, 10);
+    if (*arg == '\0' || *endptr != '\0') {
+        error_exit("Invalid %s.\n", what);
+    }
+    return n;
 }
 
-int main(int argc, char *argv[])
+/**
+ * Splits a comma separated option argument
+ */
+static std::vector<std::string> parse_opt_list(const char *arg)
 {
-    FILE *input = stdin;
-    FILE *measure_output = stdout;
-    bool opt_infile = false;
-    bool opt_info = false;
-    bool opt_measure = false;
-    unsigned long samples = 1024;
-    std::string sim_type = "CFLOBDD";
-    
+    std::vector<std::string> items;
+    std::string item;
+    for (const char *p = arg; ; p++) {
+        if (*p == ',' || *p == '\0') {
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+            item.clear();
+            if (*p == '\0') {
+                break;
+            }
+        }
+        else {
+            item += *p;
+        }
+    }
+    return items;
+}
+
+/**
+ * Parses the program arguments
+ */
+static void parse_args(int argc, char *argv[], sim_opts_t *opts)
+{
+    opts->in_path = NULL;
+    opts->measure_path = NULL;
+    opts->opt_info = false;
+    opts->opt_sweep = false;
+    opts->circuits.clear();
+    opts->sim = qsim_opts_t();
+    opts->serve_path = NULL;
+    opts->submit_path = NULL;
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    opts->limits.max_jobs = (n_cpus > 0) ? n_cpus : 1;
+    opts->limits.timeout = 0;
+    opts->limits.mem = 0;
+    opts->gen_family = NULL;
+    opts->opt_bench = false;
+    opts->bench = bench_opts_t();
+    bench_parse_range("4:16:4", &opts->bench.qubits);
+    bench_parse_range("0", &opts->bench.depths);
+    opts->bench.seed = 0;
+    opts->bench.out_path = NULL;
+    opts->bench.baseline_path = NULL;
+    opts->bench.tolerance = 0.25;
+    opts->cache_dir = NULL;
+    opts->cache_size = CACHE_DEFAULT_SIZE;
+    opts->opt_cache_stats = false;
+
     int opt;
-    static struct option long_options[] = {
-        {"help",     no_argument,        0, 'h'},
-        {"info",     no_argument,        0, 'i'},
-        {"type",     required_argument,  0, 't'},
-        {"file",     required_argument,  0, 'f'},
-        {"measure",  optional_argument,  0, 'm'},
-        {"nsamples", required_argument,  0, 'n'},
-        {0, 0, 0, 0}
-    };
-    char *endptr;
-    while((opt = getopt_long(argc, argv, "hit:f:m::n:", long_options, 0)) != -1) {
+    while((opt = getopt_long(argc, argv, SHORT_OPTS, long_options, 0)) != -1) {
         switch(opt) {
             case 'h':
                 printf("%s\n", HELP_MSG);
                 exit(0);
             case 'i':
-                opt_info = true;
+                opts->opt_info = true;
                 break;
             case 't':
-                sim_type = optarg;
-                if (sim_type != "CFLOBDD" && sim_type != "WCFLOBDD" && sim_type != "BDD" && sim_type != "WBDD") {
+                opts->sim.sim_type = optarg;
+                if (opts->sim.sim_type != "CFLOBDD" && opts->sim.sim_type != "WCFLOBDD" && opts->sim.sim_type != "BDD" && opts->sim.sim_type != "WBDD") {
                     error_exit("Invalid simulation backend option '%s'.\n", optarg);
                 }
                 break;
             case 'f':
-                opt_infile = true;
-                input = fopen(optarg, "r");
-                if (input == NULL) {
-                    error_exit("Invalid input file '%s'.\n", optarg);
-                }
+                opts->in_path = optarg;
                 break;
             case 'm':
-                opt_measure = true;
+                opts->sim.measure = true;
                 if (!optarg && optind < argc && argv[optind][0] != '-') {
                     optarg = argv[optind++];
-                    measure_output = fopen(optarg, "w");
-                    if (measure_output == NULL) {
-                        error_exit("Invalid output file '%s'.\n", optarg);
-                    }
                 }
+                opts->measure_path = optarg;
                 break;
             case 'n':
-                samples = strtoul(optarg, &endptr, 10);
-                if (*endptr != '\0') {
-                    error_exit("Invalid number of samples.\n");
+                opts->sim.samples = parse_opt_num(optarg, "number of samples");
+                break;
+            case OPT_SERVE:
+                opts->serve_path = optarg;
+                break;
+            case OPT_SUBMIT:
+                opts->submit_path = optarg;
+                break;
+            case OPT_MAX_JOBS:
+                opts->limits.max_jobs = parse_opt_num(optarg, "max. number of jobs");
+                if (opts->limits.max_jobs == 0) {
+                    error_exit("Invalid max. number of jobs.\n");
+                }
+                break;
+            case OPT_JOB_TIMEOUT:
+                opts->limits.timeout = parse_opt_num(optarg, "job timeout");
+                break;
+            case OPT_JOB_MEM:
+                opts->limits.mem = parse_opt_num(optarg, "job memory limit");
+                break;
+            case OPT_AMPLITUDE:
+                opts->sim.amplitudes.push_back(optarg);
+                break;
+            case OPT_EXPECT:
+                opts->sim.expects.push_back(optarg);
+                break;
+            case OPT_SWEEP:
+                opts->opt_sweep = true;
+                break;
+            case OPT_GENERATE:
+                opts->gen_family = optarg;
+                break;
+            case OPT_BENCH:
+                opts->opt_bench = true;
+                break;
+            case OPT_QUBITS:
+                bench_parse_range(optarg, &opts->bench.qubits);
+                break;
+            case OPT_DEPTH:
+                bench_parse_range(optarg, &opts->bench.depths);
+                break;
+            case OPT_FAMILIES:
+                opts->bench.families = parse_opt_list(optarg);
+                break;
+            case OPT_BACKENDS:
+                opts->bench.backends = parse_opt_list(optarg);
+                for (const std::string& type : opts->bench.backends) {
+                    if (type != "CFLOBDD" && type != "WCFLOBDD" && type != "BDD" && type != "WBDD") {
+                        error_exit("Invalid simulation backend option '%s'.\n", type.c_str());
+                    }
                 }
                 break;
+            case OPT_SEED:
+                opts->bench.seed = parse_opt_num(optarg, "seed");
+                opts->sim.seed = opts->bench.seed;
+                break;
+            case OPT_BENCH_OUT:
+                opts->bench.out_path = optarg;
+                break;
+            case OPT_BASELINE:
+                opts->bench.baseline_path = optarg;
+                break;
+            case OPT_MULTINOMIAL:
+                opts->sim.max_support = optarg ? parse_opt_num(optarg, "max. number of outcomes") : DEFAULT_MAX_SUPPORT;
+                if (opts->sim.max_support == 0) {
+                    error_exit("Invalid max. number of outcomes.\n");
+                }
+                break;
+            case OPT_FUSE:
+                opts->sim.fuse = true;
+                break;
+            case OPT_CACHE:
+                opts->cache_dir = optarg;
+                break;
+            case OPT_CACHE_SIZE:
+                opts->cache_size = parse_opt_num(optarg, "cache size");
+                break;
+            case OPT_CACHE_STATS:
+                opts->opt_cache_stats = true;
+                break;
+            case OPT_TOLERANCE: {
+                char *endptr;
+                opts->bench.tolerance = strtod(optarg, &endptr);
+                if (*optarg == '\0' || *endptr != '\0' || opts->bench.tolerance < 0) {
+                    error_exit("Invalid tolerance.\n");
+                }
+                break;
+            }
             case '?':
                 exit(1); // error msg already printed by getopt_long
         }
     }
 
-    // Init:
-    QuantumCircuit* qc = QuantumCircuitFactory::create(sim_type);
-    assert(qc != NULL);
-    int *bits_to_measure;
-    bool is_measure = false;
-    int n_qubits;
+    for (int i = optind; i < argc; i++) {
+        opts->circuits.push_back(argv[i]);
+    }
+    if (!opts->circuits.empty() && !opts->opt_sweep) {
+        error_exit("Unexpected argument '%s'.\n", opts->circuits[0]);
+    }
+}
 
-    // Sim:
-    struct timespec t_start, t_finish;
-    double t_el;
-    clock_gettime(CLOCK_MONOTONIC, &t_start); // Start the timer
+/**
+ * Simulates the circuit as specified by the program arguments (default_input is used if no input file is given,
+ * NULL if there is none)
+ */
+static int run_job(int argc, char *argv[], FILE *default_input)
+{
+    sim_opts_t opts;
+    parse_args(argc, argv, &opts);
+    if (opts.serve_path != NULL || opts.submit_path != NULL) {
+        error_exit("Daemon options are not allowed in a submitted job.\n");
+    }
 
-    sim_file(input, qc, &n_qubits, &bits_to_measure, &is_measure);
+    if (opts.gen_family != NULL) {
+        const gen_family_t *family = gen_get_family(opts.gen_family);
+        if (family == NULL) {
+            error_exit("Invalid benchmark family '%s'.\n", opts.gen_family);
+        }
+        if (opts.bench.qubits.start < family->min_qubits) {
+            error_exit("The family '%s' needs at least %d qubits.\n", family->name, family->min_qubits);
+        }
+        gen_circ_t circ;
+        gen_circuit(family, opts.bench.qubits.start, opts.bench.depths.start, opts.bench.seed, opts.sim.measure, &circ);
+        fputs(circ.qasm.c_str(), stdout);
+        return 0;
+    }
 
-    if (opt_measure && is_measure) {
-        // Quasimodo only supports measurement of all qubits and in the same order
-        bool valid_measure_all = true;
-        for (int i = 0; i < n_qubits; i++) {
-            if (bits_to_measure[i] != i) {
-                valid_measure_all = false;
-                break;
-            }
+    if (opts.cache_dir != NULL && !cache_init(opts.cache_dir)) {
+        error_exit("Invalid cache directory '%s'.\n", opts.cache_dir);
+    }
+    if (opts.opt_cache_stats) {
+        if (opts.cache_dir == NULL) {
+            error_exit("No cache directory given for the cache statistics.\n");
         }
-        if (valid_measure_all) {
-            measure_all(samples, measure_output, qc, n_qubits);
+        cache_stats_t stats;
+        cache_get_stats(opts.cache_dir, &stats);
+        printf("Cache Hits=%lu\n", stats.hits);
+        printf("Cache Misses=%lu\n", stats.misses);
+        printf("Cache Evictions=%lu\n", stats.evictions);
+        printf("Cache Entries=%zu\n", stats.entries);
+        printf("Cache Size=%llukB\n", (unsigned long long)(stats.size / 1024));
+        return 0;
+    }
+
+    FILE *input = default_input;
+    FILE *measure_output = stdout;
+    if (opts.measure_path != NULL) {
+        measure_output = fopen(opts.measure_path, "w");
+        if (measure_output == NULL) {
+            error_exit("Invalid output file '%s'.\n", opts.measure_path);
         }
-        else {
-            error_exit("Unsupported measurement operation - must measure all qubits and their order must remain the same.\n");
+    }
+
+    if (opts.opt_bench) {
+        opts.bench.timeout = opts.limits.timeout;
+        opts.bench.mem = opts.limits.mem;
+        opts.bench.fuse = opts.sim.fuse;
+        int ret = bench_run(&opts.bench, measure_output);
+        if (measure_output != stdout) {
+            fclose(measure_output);
         }
+        return ret;
     }
-    clock_gettime(CLOCK_MONOTONIC, &t_finish); // End the timer
-    
+    else if (opts.opt_sweep) {
+        if (opts.in_path != NULL) {
+            opts.circuits.insert(opts.circuits.begin(), opts.in_path);
+        }
+        int ret = sweep_run(opts.circuits, simulator, opts.sim, opts.opt_info, measure_output);
+        if (measure_output != stdout) {
+            fclose(measure_output);
+        }
+        return ret;
+    }
+
+    if (opts.in_path != NULL) {
+        input = input_open(opts.in_path);
+        if (input == NULL) {
+            error_exit("Invalid input file '%s'.\n", opts.in_path);
+        }
+    }
+    else if (input == NULL) {
+        error_exit("No input circuit given (use -f or send the circuit on the standard input).\n");
+    }
+
+    // Sim:
+    qsim_result_t res;
+    std::string key;
+    bool cache_hit = false;
+    bool cache_stored = false;
+    double lookup_time = 0;
+    // samples drawn without a seed differ between runs, caching them would freeze the first sample
+    bool use_cache = opts.cache_dir != NULL && !(opts.sim.measure && opts.sim.seed < 0);
+    if (use_cache) {
+        // The key needs the whole parsed circuit, the parsing is then counted in the runtime of the simulation
+        struct timespec t_start, t_finish;
+        clock_gettime(CLOCK_MONOTONIC, &t_start);
+        circuit_t circuit;
+        parse_file(input, &circuit);
+        key = cache_key(circuit, opts.sim);
+        cache_hit = cache_load(opts.cache_dir, key, &res);
+        clock_gettime(CLOCK_MONOTONIC, &t_finish);
+        lookup_time = t_finish.tv_sec - t_start.tv_sec + (t_finish.tv_nsec - t_start.tv_nsec) * 1.0e-9;
+
+        if (!cache_hit) {
+            if (simulator->run_circuit(circuit, opts.sim, &res) != QSIM_OK) {
+                error_exit("%s\n", res.error.c_str());
+            }
+            res.time += lookup_time;
+            cache_stored = cache_store(opts.cache_dir, key, res, (uint64_t)opts.cache_size << 20);
+        }
+    }
+    else if (simulator->run_file(input, opts.sim, &res) != QSIM_OK) {
+        error_exit("%s\n", res.error.c_str());
+    }
+
     // Output:
-    t_el = t_finish.tv_sec - t_start.tv_sec + (t_finish.tv_nsec - t_start.tv_nsec) * 1.0e-9;
-    if (opt_info) {
-        printf("Time=%.3gs\n", t_el);
+    qsim_print_result(opts.sim, res, measure_output);
+    if (opts.opt_info) {
+        printf("Time=%.3gs\n", res.time);
         #if defined(__unix__) || defined(__APPLE__)
-            printf("Peak Memory Usage=%ldkB\n", get_peak_mem());
+            printf("Peak Memory Usage=%ldkB\n", res.peak_mem);
         #else
             printf("Peak Memory Usage not supported for this OS.\n");
         #endif
+        if (opts.sim.max_support > 0 && opts.sim.measure && res.is_measure) {
+            if (res.support > 0) {
+                printf("Sampling=multinomial (%zu outcomes)\n", res.support);
+            }
+            else {
+                printf("Sampling=every shot (more than %zu outcomes or a too spread state)\n", opts.sim.max_support);
+            }
+        }
+        if (opts.sim.fuse) {
+            const fuse_stats_t& fs = res.fuse_stats;
+            printf("Fused Gates=%zu -> %zu (%zu saved: %u ladders, %u cswaps, %u cancelled pairs)\n", fs.gates_before,
+                   fs.gates_after, fs.gates_before - fs.gates_after, fs.ladders, fs.cswaps, fs.cancelled);
+        }
+        if (opts.cache_dir != NULL) {
+            if (!use_cache) {
+                printf("Cache=skipped (measured without --seed)\n");
+            }
+            else if (cache_hit) {
+                // the time and memory above are those of the original run
+                printf("Cache=hit %s (lookup %.3gs)\n", key.c_str(), lookup_time);
+            }
+            else {
+                printf("Cache=miss %s (%s)\n", key.c_str(), cache_stored ? "stored" : "not stored");
+            }
+        }
     }
 
     // Finish:
-    if (opt_infile) {
+    if (input != default_input) {
         fclose(input);
     }
+    if (measure_output != stdout) {
+        fclose(measure_output);
+    }
 
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * Returns true if the job reads its circuit from the standard input (generated circuits, the benchmarks,
+ * the sweep and the cache statistics never do)
+ */
+static bool reads_stdin(const sim_opts_t *opts)
+{
+    return opts->in_path == NULL && opts->gen_family == NULL && !opts->opt_bench && !opts->opt_sweep
+           && !opts->opt_cache_stats;
+}
+
+/**
+ * Returns the program arguments without the '--submit' option to be forwarded to the daemon. The option is found
+ * by getopt_long (in any accepted form, e.g. abbreviated), the original order of the arguments is kept.
+ */
+static std::vector<char*> get_job_args(int argc, char *argv[])
+{
+    std::vector<char*> args;
+    int opt;
+    int prev = 1;  // first argument not yet forwarded
+    optind = 0;
+    opterr = 0;    // the arguments were already checked by parse_args
+    // '-' returns the non-option arguments in place instead of permuting them
+    while ((opt = getopt_long(argc, argv, "-" SHORT_OPTS, long_options, 0)) != -1) {
+        if (opt != OPT_SUBMIT) {
+            args.insert(args.end(), argv + prev, argv + optind);
+        }
+        prev = optind;
+    }
+    args.insert(args.end(), argv + prev, argv + argc);
+    optind = 0;
+    opterr = 1;
+    return args;
+}
+
+int main(int argc, char *argv[])
+{
+    // getopt_long permutes the arguments, keep the original order for forwarding
+    std::vector<char*> orig_args(argv, argv + argc);
+
+    sim_opts_t opts;
+    parse_args(argc, argv, &opts);
+
+    if (opts.serve_path != NULL) {
+        // Initialize all backends once, the jobs get them through copy-on-write
+        simulator->get_backend("CFLOBDD");
+        simulator->get_backend("WCFLOBDD");
+        simulator->get_backend("BDD");
+        simulator->get_backend("WBDD");
+        server_run(opts.serve_path, &opts.limits, run_job);
+        return 0;
+    }
+    else if (opts.submit_path != NULL) {
+        std::vector<char*> args = get_job_args(argc, orig_args.data());
+        return server_submit(opts.submit_path, args.size(), args.data(), reads_stdin(&opts) ? stdin : NULL);
+    }
+
+    optind = 0; // the arguments are parsed again by the job
+    return run_job(argc, argv, stdin);
+}
@@ -12,3 +12,15 @@ QuantumCircuit* QuantumCircuitFactory::create(const std::string& type) {
     else
         return NULL;
 }
+
+void QuantumCircuitFactory::destroy(const std::string& type, QuantumCircuit* qc) {
+    // deleted through the concrete type, the base class destructor is not virtual
+    if (type == "CFLOBDD")
+        delete static_cast<CFLOBDDQuantumCircuit*>(qc);
+    else if (type == "WCFLOBDD")
+        delete static_cast<WeightedCFLOBDDQuantumCircuit*>(qc);
+    else if (type == "BDD")
+        delete static_cast<BDDQuantumCircuit*>(qc);
+    else if (type == "WBDD")
+        delete static_cast<MQTDDCircuit*>(qc);
+}
@@ -6,4 +6,5 @@
 class QuantumCircuitFactory {
 public:
     static QuantumCircuit* create(const std::string& type);
-};
\ No newline at end of file
+    static void destroy(const std::string& type, QuantumCircuit* qc);
+};
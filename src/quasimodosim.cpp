@@ -0,0 +1,217 @@
+#include <time.h>
+#include <sys/resource.h>
+#include <new>
+#include <random>
+
+#include "quasimodosim.h"
+#include "quantum_circuit_factory.h"
+#include "query.h"
+
+QuasimodoSim::~QuasimodoSim()
+{
+    for (auto& backend : backends) {
+        QuantumCircuitFactory::destroy(backend.first, backend.second);
+    }
+}
+
+QuantumCircuit* QuasimodoSim::get_backend(const std::string& sim_type)
+{
+    auto it = backends.find(sim_type);
+    if (it != backends.end()) {
+        return it->second;
+    }
+    QuantumCircuit* qc = QuantumCircuitFactory::create(sim_type);
+    if (qc != NULL) {
+        backends[sim_type] = qc;
+    }
+    return qc;
+}
+
+typedef struct histogram_ctx {   // Data for adding the sampled states to the histogram
+    const sim_state_t *st;
+    std::map<std::string, unsigned long> *histogram;
+} histogram_ctx_t;
+
+/**
+ * Adds the sampled state to the histogram (the sampled key is stored as LSBF over the physical qubits)
+ */
+static void add_to_histogram(htab_m_key_t key, htab_value_t value, void *data)
+{
+    histogram_ctx_t *ctx = (histogram_ctx_t*)data;
+    int n = ctx->st->n_qubits;
+    std::string state(n, '0');
+    for (int q = 0; q < n; q++) {
+        state[n - 1 - q] = key[ctx->st->phys[q]];
+    }
+    (*ctx->histogram)[state] += value;
+}
+
+qsim_status_t QuasimodoSim::run(const qsim_opts_t& opts, qsim_result_t *res, const std::function<void(sim_state_t*)>& simulate)
+{
+    *res = qsim_result_t();
+
+    sim_state_t st;
+    st.circ = get_backend(opts.sim_type);
+    st.n_qubits = 0;
+    st.is_measure = false;
+    if (st.circ == NULL) {
+        res->error = "Invalid simulation backend option '" + opts.sim_type + "'.";
+        return QSIM_ERR_ARG;
+    }
+
+    qsim_status_t status = QSIM_OK;
+    struct timespec t_start, t_finish;
+    clock_gettime(CLOCK_MONOTONIC, &t_start); // Start the timer
+
+    try {
+        RecoverableErrorGuard recoverable;
+        simulate(&st);
+        status = qsim_collect(&st, opts, res);
+    }
+    catch (const SimIOError& e) {
+        res->error = e.what();
+        status = QSIM_ERR_IO;
+    }
+    catch (const SimError& e) {
+        res->error = e.what();
+        status = QSIM_ERR_CIRCUIT;
+    }
+    catch (const std::bad_alloc& e) {
+        res->error = "Bad memory allocation.";
+        status = QSIM_ERR_CIRCUIT;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t_finish); // End the timer
+    res->time = t_finish.tv_sec - t_start.tv_sec + (t_finish.tv_nsec - t_start.tv_nsec) * 1.0e-9;
+    res->peak_mem = qsim_peak_mem();
+
+    return status;
+}
+
+qsim_status_t QuasimodoSim::run_file(FILE *in, const qsim_opts_t& opts, qsim_result_t *res)
+{
+    if (in == NULL) {
+        *res = qsim_result_t();
+        res->error = "Invalid input stream.";
+        return QSIM_ERR_IO;
+    }
+    if (opts.fuse) {
+        return run(opts, res, [in, res](sim_state_t *st) {
+            circuit_t circuit;
+            parse_file(in, &circuit);
+            fuse_circuit(&circuit, &res->fuse_stats);
+            sim_circuit(&circuit, st);
+        });
+    }
+    return run(opts, res, [in](sim_state_t *st) { sim_file(in, st); });
+}
+
+qsim_status_t QuasimodoSim::run_string(const char *buf, size_t len, const qsim_opts_t& opts, qsim_result_t *res)
+{
+    if (buf == NULL || len == 0) {
+        *res = qsim_result_t();
+        res->error = "Empty circuit.";
+        return QSIM_ERR_ARG;
+    }
+
+    FILE *in = fmemopen((void*)buf, len, "r");
+    if (in == NULL) {
+        *res = qsim_result_t();
+        res->error = "Could not open the circuit buffer.";
+        return QSIM_ERR_IO;
+    }
+    qsim_status_t status = run_file(in, opts, res);
+    fclose(in);
+    return status;
+}
+
+qsim_status_t QuasimodoSim::run_string(const std::string& text, const qsim_opts_t& opts, qsim_result_t *res)
+{
+    return run_string(text.data(), text.size(), opts, res);
+}
+
+qsim_status_t QuasimodoSim::run_circuit(const circuit_t& circuit, const qsim_opts_t& opts, qsim_result_t *res)
+{
+    if (opts.fuse) {
+        return run(opts, res, [&circuit, res](sim_state_t *st) {
+            circuit_t fused = circuit;
+            fuse_circuit(&fused, &res->fuse_stats);
+            sim_circuit(&fused, st);
+        });
+    }
+    return run(opts, res, [&circuit](sim_state_t *st) { sim_circuit(&circuit, st); });
+}
+
+qsim_status_t qsim_collect(sim_state_t *st, const qsim_opts_t& opts, qsim_result_t *res)
+{
+    res->n_qubits = st->n_qubits;
+    res->is_measure = st->is_measure;
+
+    if (opts.measure && st->is_measure) {
+        // Quasimodo only supports measurement of all qubits and in the same order
+        bool valid_measure_all = true;
+        for (int i = 0; i < st->n_qubits; i++) {
+            if (st->bits_to_measure[i] != i) {
+                valid_measure_all = false;
+                break;
+            }
+        }
+        if (valid_measure_all) {
+            htab_t *state_table = NULL;
+            if (opts.max_support > 0 && opts.samples > 0) {
+                uint64_t seed = (opts.seed >= 0) ? opts.seed : std::random_device()();
+                state_table = measure_all_multinomial(opts.samples, st->circ, st->n_qubits, opts.max_support, seed, &res->support);
+            }
+            if (state_table == NULL) {
+                // too large support, every shot is sampled
+                state_table = measure_all(opts.samples, st->circ, st->n_qubits);
+            }
+            histogram_ctx_t ctx = {st, &res->histogram};
+            htab_m_for_each(state_table, add_to_histogram, &ctx);
+            htab_m_free(state_table);
+        }
+        else {
+            res->error = "Unsupported measurement operation - must measure all qubits and their order must remain the same.";
+            return QSIM_ERR_UNSUPPORTED;
+        }
+    }
+    // The queries are given over the logical qubits
+    std::vector<std::string> states, paulis;
+    for (const std::string& s : opts.amplitudes) {
+        states.push_back(sim_to_physical(st, s));
+    }
+    for (const std::string& p : opts.expects) {
+        paulis.push_back(sim_to_physical(st, p));
+    }
+    res->probabilities = query_probabilities(states, st->circ, st->n_qubits);
+    res->expectations = query_expectations(paulis, st->circ, st->n_qubits);
+    return QSIM_OK;
+}
+
+long qsim_peak_mem()
+{
+    long peak = 0;
+    #if defined(__unix__) || defined(__APPLE__)
+        struct rusage rs_usage;
+        if (getrusage(RUSAGE_SELF, &rs_usage) == 0) {
+            peak = rs_usage.ru_maxrss;
+        }
+    #else
+        // Unknown OS
+        peak = -1;
+    #endif
+    return peak;
+}
+
+void qsim_print_result(const qsim_opts_t& opts, const qsim_result_t& res, FILE *output)
+{
+    if (opts.measure && res.is_measure) {
+        fprintf(output, "Sampled results:\n");
+        for (const auto& state : res.histogram) {
+            fprintf(output, "    \'%s\'    %lu\n", state.first.c_str(), state.second);
+        }
+    }
+    query_print(opts.amplitudes, res.probabilities, opts.expects, res.expectations, output);
+}
+
+/* end of "quasimodosim.c" */
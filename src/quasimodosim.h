@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+#include "sim.h"
+#include "fuse.h"
+#include "quantum_circuit.h"
+
+#ifndef QUASIMODOSIM_H
+#define QUASIMODOSIM_H
+
+/**
+ * Status codes returned by the library
+ */
+typedef enum qsim_status {
+    QSIM_OK = 0,
+    QSIM_ERR_ARG,            // Invalid argument (e.g. an unknown backend type)
+    QSIM_ERR_IO,             // The circuit could not be read
+    QSIM_ERR_CIRCUIT,        // Invalid circuit or a failure during the simulation
+    QSIM_ERR_UNSUPPORTED     // Unsupported operation (e.g. measurement of only some qubits)
+} qsim_status_t;
+
+typedef struct qsim_opts {       // Options of a single simulation run
+    std::string sim_type = "CFLOBDD";    // Backend type: 'CFLOBDD', 'WCFLOBDD', 'BDD' or 'WBDD'
+    bool measure = false;                // Sample the measured qubits
+    unsigned long samples = 1024;        // Number of samples used for measurement
+    size_t max_support = 0;              // Max. outcome support drawn by a single multinomial draw (0 to sample every shot)
+    long long seed = -1;                 // Seed of the multinomial draw (-1 for a random seed)
+    std::vector<std::string> amplitudes; // Basis states whose probabilities are computed (qubit 0 is the last bit)
+    std::vector<std::string> expects;    // Pauli strings whose expectation values are computed
+    bool fuse = false;                   // Parse the whole circuit first and fuse gate blocks into native gates
+} qsim_opts_t;
+
+typedef struct qsim_result {     // Result of a single simulation run
+    int n_qubits = 0;
+    bool is_measure = false;     // True if some measure operation is present in the circuit
+    std::map<std::string, unsigned long> histogram; // Sampled states (qubit 0 is the last bit) and their counts
+    size_t support = 0;          // Size of the outcome support if sampled by the multinomial draw (0 if sampled every shot)
+    std::vector<long double> probabilities; // Probabilities of the queried basis states
+    std::vector<long double> expectations;  // Expectation values of the queried Pauli strings
+    double time = 0;             // Wall-clock time of the simulation in seconds
+    long peak_mem = 0;           // Peak physical memory usage of the process in kB (-1 if not supported)
+    fuse_stats_t fuse_stats;     // Statistics of the gate fusion (only if enabled)
+    std::string error;           // Error message if the run failed
+} qsim_result_t;
+
+/**
+ * Simulator session, the backends are created on their first use and reused by all following runs.
+ * Errors are reported by the returned status codes and the error message in the result.
+ * The backends share global state, a process should therefore use the session from a single thread only.
+ */
+class QuasimodoSim {
+public:
+    QuasimodoSim() = default;
+    QuasimodoSim(const QuasimodoSim&) = delete;
+    QuasimodoSim& operator=(const QuasimodoSim&) = delete;
+    ~QuasimodoSim();
+
+    /**
+     * Returns the backend of the given type (created on the first use), NULL for an unknown type
+     */
+    QuantumCircuit* get_backend(const std::string& sim_type);
+
+    /**
+     * Simulates a QASM circuit read from the given stream (the gates are applied while parsing unless fused)
+     */
+    qsim_status_t run_file(FILE *in, const qsim_opts_t& opts, qsim_result_t *res);
+
+    /**
+     * Simulates a QASM circuit given as a text buffer
+     */
+    qsim_status_t run_string(const char *buf, size_t len, const qsim_opts_t& opts, qsim_result_t *res);
+    qsim_status_t run_string(const std::string& text, const qsim_opts_t& opts, qsim_result_t *res);
+
+    /**
+     * Simulates a programmatically built (or already parsed) circuit
+     */
+    qsim_status_t run_circuit(const circuit_t& circuit, const qsim_opts_t& opts, qsim_result_t *res);
+
+private:
+    std::map<std::string, QuantumCircuit*> backends;
+
+    qsim_status_t run(const qsim_opts_t& opts, qsim_result_t *res, const std::function<void(sim_state_t*)>& simulate);
+};
+
+/**
+ * Collects the results (samples and queried values) of an already simulated circuit. Unlike the session methods,
+ * invalid queries are reported by error_exit() (i.e. they are recoverable only if set by error_set_recoverable()).
+ */
+qsim_status_t qsim_collect(sim_state_t *st, const qsim_opts_t& opts, qsim_result_t *res);
+
+/**
+ * Returns the peak physical memory usage of the process in kilobytes. For an unsupported OS returns -1.
+ */
+long qsim_peak_mem();
+
+/**
+ * Prints the sampled results and the queried values to the given stream (in the format of the command line simulator)
+ */
+void qsim_print_result(const qsim_opts_t& opts, const qsim_result_t& res, FILE *output);
+
+#endif
+/* end of "quasimodosim.h" */
@@ -0,0 +1,170 @@
+#include <ctype.h>
+#include <math.h>
+#include <map>
+
+#include "query.h"
+
+/**
+ * Basis of a qubit used when evaluating an observable (the identity needs no basis)
+ */
+typedef enum basis {
+    BASIS_NONE,
+    BASIS_X,
+    BASIS_Y,
+    BASIS_Z
+} basis_t;
+
+/**
+ * Returns the basis of the given Pauli operator character
+ */
+static basis_t get_basis(char p)
+{
+    switch (toupper(p)) {
+        case 'I':
+            return BASIS_NONE;
+        case 'X':
+            return BASIS_X;
+        case 'Y':
+            return BASIS_Y;
+        case 'Z':
+            return BASIS_Z;
+        default:
+            error_exit("Invalid Pauli operator '%c'.\n", p);
+    }
+    return BASIS_NONE;
+}
+
+/**
+ * Rotates the given qubits so that measuring them in the Z basis corresponds to the given bases (or undoes the rotation)
+ */
+static void change_basis(QuantumCircuit *circ, const std::vector<basis_t>& bases, bool undo)
+{
+    for (size_t q = 0; q < bases.size(); q++) {
+        if (bases[q] == BASIS_X) {
+            circ->ApplyHadamardGate(q);
+        }
+        else if (bases[q] == BASIS_Y) {
+            // Y basis: S^dagger followed by H
+            if (undo) {
+                circ->ApplyHadamardGate(q);
+                circ->ApplySGate(q);
+            }
+            else {
+                circ->ApplyPhaseShiftGate(q, -M_PI / 2);
+                circ->ApplyHadamardGate(q);
+            }
+        }
+    }
+}
+
+std::vector<long double> query_probabilities(const std::vector<std::string>& states, QuantumCircuit *circ, int n)
+{
+    std::vector<long double> probs;
+    std::map<unsigned int, int> qubit_vals;
+
+    for (const std::string& s : states) {
+        if (s.length() != (size_t)n) {
+            error_exit("Invalid basis state '%s' - expected %d bits.\n", s.c_str(), n);
+        }
+        qubit_vals.clear();
+        for (int q = 0; q < n; q++) {
+            char c = s[n - 1 - q];
+            if (c != '0' && c != '1') {
+                error_exit("Invalid basis state '%s' - not a bit string.\n", s.c_str());
+            }
+            qubit_vals[q] = c - '0';
+        }
+        probs.push_back(circ->GetProbability(qubit_vals));
+    }
+    return probs;
+}
+
+std::vector<long double> query_expectations(const std::vector<std::string>& paulis, QuantumCircuit *circ, int n)
+{
+    std::vector<long double> expects(paulis.size(), 0);
+
+    // Group the observables by compatible measurement bases (greedily)
+    std::vector<std::vector<basis_t>> group_bases;
+    std::vector<std::vector<size_t>> groups;
+    for (size_t i = 0; i < paulis.size(); i++) {
+        if (paulis[i].length() != (size_t)n) {
+            error_exit("Invalid Pauli string '%s' - expected %d operators.\n", paulis[i].c_str(), n);
+        }
+        std::vector<basis_t> bases(n);
+        for (int q = 0; q < n; q++) {
+            bases[q] = get_basis(paulis[i][n - 1 - q]);
+        }
+
+        size_t g;
+        for (g = 0; g < groups.size(); g++) {
+            bool compatible = true;
+            for (int q = 0; q < n && compatible; q++) {
+                compatible = (bases[q] == BASIS_NONE || group_bases[g][q] == BASIS_NONE || bases[q] == group_bases[g][q]);
+            }
+            if (compatible) {
+                break;
+            }
+        }
+        if (g == groups.size()) {
+            group_bases.push_back(std::vector<basis_t>(n, BASIS_NONE));
+            groups.push_back(std::vector<size_t>());
+        }
+        for (int q = 0; q < n; q++) {
+            if (bases[q] != BASIS_NONE) {
+                group_bases[g][q] = bases[q];
+            }
+        }
+        groups[g].push_back(i);
+    }
+
+    std::map<unsigned int, int> qubit_vals;
+    for (size_t g = 0; g < groups.size(); g++) {
+        change_basis(circ, group_bases[g], false);
+
+        for (size_t i : groups[g]) {
+            // <P> = 1 - 2 * P(odd parity of the support), the parity is computed into the last support qubit
+            std::vector<long int> support;
+            for (int q = 0; q < n; q++) {
+                if (toupper(paulis[i][n - 1 - q]) != 'I') {
+                    support.push_back(q);
+                }
+            }
+            if (support.empty()) {
+                expects[i] = 1;
+                continue;
+            }
+            long int target = support.back();
+            for (size_t k = 0; k + 1 < support.size(); k++) {
+                circ->ApplyCNOTGate(support[k], target);
+            }
+            qubit_vals.clear();
+            qubit_vals[target] = 1;
+            expects[i] = 1 - 2 * circ->GetProbability(qubit_vals);
+            for (size_t k = 0; k + 1 < support.size(); k++) {
+                circ->ApplyCNOTGate(support[k], target);
+            }
+        }
+
+        change_basis(circ, group_bases[g], true);
+    }
+    return expects;
+}
+
+void query_print(const std::vector<std::string>& states, const std::vector<long double>& probs,
+                 const std::vector<std::string>& paulis, const std::vector<long double>& expects, FILE *output)
+{
+    if (!states.empty()) {
+        fprintf(output, "Probabilities:\n");
+        for (size_t i = 0; i < states.size(); i++) {
+            fprintf(output, "    \'%s\'    %.10Lg    |amplitude|=%.10Lg\n", states[i].c_str(), probs[i], sqrtl(probs[i]));
+        }
+    }
+    if (!paulis.empty()) {
+        fprintf(output, "Expectation values:\n");
+        for (size_t i = 0; i < paulis.size(); i++) {
+            fprintf(output, "    \'%s\'    %.10Lg\n", paulis[i].c_str(), expects[i]);
+        }
+    }
+}
+
+/* end of "query.c" */
@@ -0,0 +1,47 @@
+#include <stdbool.h>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "quantum_circuit.h"
+
+#ifndef QUERY_H
+#define QUERY_H
+
+/**
+ * Computes the probabilities of the given basis states directly from the final state (without sampling)
+ *
+ * @param states basis states given as bit strings, the last character corresponds to qubit 0
+ *
+ * @param circ the state vector of the circuit
+ *
+ * @param n number of qubits in the circuit
+ *
+ * @return probability (squared amplitude magnitude) of every state in the same order
+ *
+ */
+std::vector<long double> query_probabilities(const std::vector<std::string>& states, QuantumCircuit *circ, int n);
+
+/**
+ * Computes the expectation values of the given Pauli strings directly from the final state (without sampling).
+ * Observables measured in a compatible basis share a single basis change of the state, which is undone afterwards.
+ *
+ * @param paulis Pauli strings consisting of 'I', 'X', 'Y', 'Z', the last character corresponds to qubit 0
+ *
+ * @param circ the state vector of the circuit
+ *
+ * @param n number of qubits in the circuit
+ *
+ * @return expectation value of every observable in the same order
+ *
+ */
+std::vector<long double> query_expectations(const std::vector<std::string>& paulis, QuantumCircuit *circ, int n);
+
+/**
+ * Prints the queried probabilities and expectation values to the given stream
+ */
+void query_print(const std::vector<std::string>& states, const std::vector<long double>& probs,
+                 const std::vector<std::string>& paulis, const std::vector<long double>& expects, FILE *output);
+
+#endif
+/* end of "query.h" */
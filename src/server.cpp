@@ -0,0 +1,345 @@
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "server.h"
+
+/** Marks the end of the job output, it is followed by the exit code of the job. */
+#define EXIT_MARK '\0'
+#define NUM_STR_LEN 32 // Max. length of a number sent in the request
+
+/**
+ * Fills the socket address with the given path
+ */
+static void set_addr(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) + 1 > sizeof(addr->sun_path)) {
+        error_exit("Socket path '%s' is too long.\n", path);
+    }
+    strcpy(addr->sun_path, path);
+}
+
+/**
+ * Writes the whole buffer to the given file descriptor, returns false on failure
+ */
+static bool write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * Reads the next '\0' terminated string of the request, returns NULL on failure
+ */
+static char* read_field(FILE *req)
+{
+    char *field = NULL;
+    size_t len = 0;
+    if (getdelim(&field, &len, '\0', req) < 0) {
+        free(field);
+        return NULL;
+    }
+    return field;
+}
+
+/**
+ * Reads the rest of the request (the inline circuit) into a memory stream
+ */
+static FILE* read_inline(FILE *req)
+{
+    size_t size = 0;
+    size_t cap = BUFSIZ;
+    char *buf = (char*)my_malloc(cap);
+    size_t n;
+
+    while ((n = fread(buf + size, 1, cap - size, req)) > 0) {
+        size += n;
+        if (size == cap) {
+            cap *= 2;
+            buf = (char*)my_realloc(buf, cap);
+        }
+    }
+    // the buffer is intentionally kept for the lifetime of the worker
+    return fmemopen(buf, size, "r");
+}
+
+/** Set when the time limit of the running job expires. */
+static volatile sig_atomic_t job_timed_out = 0;
+
+static void on_job_timeout(int sig)
+{
+    (void)sig;
+    job_timed_out = 1;
+}
+
+/**
+ * Handles a single accepted connection (runs in the forked child), returns the exit code
+ */
+static int serve_request(int conn, const server_limits_t *limits, job_func_t job)
+{
+    FILE *req = fdopen(dup(conn), "r");
+    if (req == NULL) {
+        return 1;
+    }
+
+    // Header: magic, working directory, argument count, arguments and the input mode
+    char *magic = read_field(req);
+    if (magic == NULL || strcmp(magic, SERVER_MAGIC) != 0) {
+        dprintf(conn, "%sInvalid request.\n%c1", ERROR_TEXT, EXIT_MARK);
+        return 1;
+    }
+    char *cwd = read_field(req);
+    char *argc_str = read_field(req);
+    if (cwd == NULL || argc_str == NULL) {
+        dprintf(conn, "%sInvalid request header.\n%c1", ERROR_TEXT, EXIT_MARK);
+        return 1;
+    }
+    int argc = atoi(argc_str) + 1;
+    if (argc < 1) {
+        dprintf(conn, "%sInvalid number of arguments.\n%c1", ERROR_TEXT, EXIT_MARK);
+        return 1;
+    }
+    char **argv = (char**)my_malloc((argc + 1) * sizeof(char*));
+    argv[0] = (char*)"QuasimodoSim";
+    for (int i = 1; i < argc; i++) {
+        if ((argv[i] = read_field(req)) == NULL) {
+            dprintf(conn, "%sInvalid request arguments.\n%c1", ERROR_TEXT, EXIT_MARK);
+            return 1;
+        }
+    }
+    argv[argc] = NULL;
+
+    char *mode = read_field(req);
+    FILE *input = NULL; // in the "path" mode the job has no circuit on its input (never the daemon's stdin)
+    if (mode != NULL && strcmp(mode, "inline") == 0) {
+        input = read_inline(req);
+        if (input == NULL) {
+            dprintf(conn, "%sCould not open the inline circuit.\n%c1", ERROR_TEXT, EXIT_MARK);
+            return 1;
+        }
+    }
+    else if (mode == NULL || strcmp(mode, "path") != 0) {
+        dprintf(conn, "%sInvalid request input mode.\n%c1", ERROR_TEXT, EXIT_MARK);
+        return 1;
+    }
+    fclose(req);
+
+    // Worker running the job itself
+    pid_t pid = fork();
+    if (pid < 0) {
+        dprintf(conn, "%sCould not start the job.\n%c1", ERROR_TEXT, EXIT_MARK);
+        return 1;
+    }
+    else if (pid == 0) {
+        // the job runs in its own process group, so that the processes it forks are killed with it
+        setpgid(0, 0);
+        if (chdir(cwd) != 0) {
+            dprintf(conn, "%sInvalid working directory '%s'.\n", ERROR_TEXT, cwd);
+            _exit(1);
+        }
+        if (limits->mem) {
+            struct rlimit rl;
+            rl.rlim_cur = rl.rlim_max = limits->mem * 1024 * 1024;
+            setrlimit(RLIMIT_AS, &rl);
+        }
+        dup2(conn, STDOUT_FILENO);
+        dup2(conn, STDERR_FILENO);
+        close(conn);
+        optind = 0; // reinitialize getopt for the job arguments
+        exit(job(argc, argv, input));
+    }
+
+    setpgid(pid, pid); // also set here, the group must exist before it can be killed
+
+    // The time limit is watched here, the whole process group of the job is killed when it expires
+    if (limits->timeout) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_job_timeout; // no SA_RESTART, so that the waiting is interrupted
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGALRM, &sa, NULL);
+        alarm(limits->timeout);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            kill(-pid, SIGKILL);
+            dprintf(conn, "%sLost the job.\n%c1", ERROR_TEXT, EXIT_MARK);
+            return 1;
+        }
+        if (job_timed_out) {
+            kill(-pid, SIGKILL);
+        }
+    }
+    alarm(0);
+    kill(-pid, SIGKILL); // processes left behind by the job would keep the connection open
+
+    int code;
+    if (WIFEXITED(status)) {
+        code = WEXITSTATUS(status);
+    }
+    else {
+        code = 128 + WTERMSIG(status);
+        if (job_timed_out) {
+            dprintf(conn, "%sJob exceeded the time limit (%us).\n", ERROR_TEXT, limits->timeout);
+        }
+        else {
+            dprintf(conn, "%sJob terminated by signal %d (%s).\n", ERROR_TEXT, WTERMSIG(status), strsignal(WTERMSIG(status)));
+        }
+    }
+    dprintf(conn, "%c%d", EXIT_MARK, code);
+    return 0;
+}
+
+/**
+ * Waits for a finished request handler, returns true if some handler was reaped
+ */
+static bool reap_request(bool block)
+{
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, block ? 0 : WNOHANG)) < 0 && errno == EINTR) {}
+    return pid > 0;
+}
+
+void server_run(const char *path, const server_limits_t *limits, job_func_t job)
+{
+    struct sockaddr_un addr;
+    set_addr(&addr, path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        error_exit("Could not create the server socket.\n");
+    }
+    unlink(path); // remove a stale socket
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        error_exit("Could not bind the server socket '%s'.\n", path);
+    }
+    if (listen(sock, SOMAXCONN) != 0) {
+        error_exit("Could not listen on the server socket '%s'.\n", path);
+    }
+    signal(SIGPIPE, SIG_IGN); // disconnected clients must not kill the daemon
+
+    printf("Serving on '%s' (max. %u concurrent jobs).\n", path, limits->max_jobs);
+    fflush(stdout);
+
+    unsigned running = 0;
+    while (true) {
+        // Respect the limit of concurrently running jobs
+        while (running > 0 && reap_request(running >= limits->max_jobs)) {
+            running--;
+        }
+
+        int conn = accept(sock, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            error_exit("Could not accept a connection on the server socket.\n");
+        }
+
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid < 0) {
+            dprintf(conn, "%sCould not start the job.\n%c1", ERROR_TEXT, EXIT_MARK);
+        }
+        else if (pid == 0) {
+            close(sock);
+            _exit(serve_request(conn, limits, job));
+        }
+        else {
+            running++;
+        }
+        close(conn);
+    }
+}
+
+int server_submit(const char *path, int argc, char **argv, FILE *input)
+{
+    struct sockaddr_un addr;
+    set_addr(&addr, path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        error_exit("Could not create the client socket.\n");
+    }
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        error_exit("Could not connect to the server socket '%s'.\n", path);
+    }
+
+    // Send the request header
+    char cwd[PATH_MAX];
+    char argc_str[NUM_STR_LEN];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        error_exit("Could not get the current working directory.\n");
+    }
+    snprintf(argc_str, sizeof(argc_str), "%d", argc);
+    const char *mode = (input == NULL) ? "path" : "inline";
+
+    bool ok = write_all(sock, SERVER_MAGIC, sizeof(SERVER_MAGIC))
+              && write_all(sock, cwd, strlen(cwd) + 1)
+              && write_all(sock, argc_str, strlen(argc_str) + 1);
+    for (int i = 0; ok && i < argc; i++) {
+        ok = write_all(sock, argv[i], strlen(argv[i]) + 1);
+    }
+    ok = ok && write_all(sock, mode, strlen(mode) + 1);
+
+    // Send the inline circuit
+    char buf[BUFSIZ];
+    size_t n;
+    while (ok && input != NULL && (n = fread(buf, 1, sizeof(buf), input)) > 0) {
+        ok = write_all(sock, buf, n);
+    }
+    if (!ok) {
+        error_exit("Could not send the job to the server.\n");
+    }
+    shutdown(sock, SHUT_WR);
+
+    // Copy the job output until the exit mark
+    ssize_t len;
+    bool is_exit = false;
+    char code_str[NUM_STR_LEN] = {0};
+    size_t code_len = 0;
+    while ((len = read(sock, buf, sizeof(buf))) > 0 || (len < 0 && errno == EINTR)) {
+        for (ssize_t i = 0; i < len; i++) {
+            if (is_exit) {
+                if (code_len + 1 < NUM_STR_LEN) {
+                    code_str[code_len++] = buf[i];
+                }
+            }
+            else if (buf[i] == EXIT_MARK) {
+                is_exit = true;
+            }
+            else {
+                putchar(buf[i]);
+            }
+        }
+    }
+    close(sock);
+
+    if (!is_exit) {
+        error_exit("Connection to the server was closed before the job finished.\n");
+    }
+    return atoi(code_str);
+}
+
+/* end of "server.c" */
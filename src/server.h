@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "error.h"
+
+#ifndef SERVER_H
+#define SERVER_H
+
+/** Protocol identifier sent by the client at the start of every request. */
+#define SERVER_MAGIC "QSIM1"
+
+/**
+ * Function running a single job inside the forked worker process (the arguments are the client's
+ * program arguments, input is the circuit sent inline to be used when no input file is given or NULL if none
+ * was sent, returns the exit code)
+ */
+typedef int (*job_func_t)(int argc, char **argv, FILE *input);
+
+typedef struct server_limits {   // Limits applied to the jobs submitted to the daemon
+    unsigned max_jobs;           // Max. number of concurrently running jobs
+    unsigned timeout;            // Max. wall-clock time of a job in seconds (0 for no limit)
+    unsigned long mem;           // Max. address space of a job in MB (0 for no limit)
+} server_limits_t;
+
+/**
+ * Runs the simulation daemon listening on the given unix socket. Every accepted request is handled
+ * by a forked copy-on-write child, so everything initialized before the call is shared by all jobs.
+ *
+ * @param path path of the unix socket
+ *
+ * @param limits limits of the submitted jobs
+ *
+ * @param job function running a single job
+ *
+ */
+void server_run(const char *path, const server_limits_t *limits, job_func_t job);
+
+/**
+ * Submits a job to the daemon and copies the job output to the standard output.
+ *
+ * @param path path of the daemon's unix socket
+ *
+ * @param argc number of the program arguments for the job
+ *
+ * @param argv program arguments for the job (without the program name)
+ *
+ * @param input circuit to be sent inline, NULL if the job specifies its input file
+ *
+ * @return exit code of the job
+ *
+ */
+int server_submit(const char *path, int argc, char **argv, FILE *input);
+
+#endif
+/* end of "server.h" */
@@ -1,12 +1,33 @@
+#include <algorithm>
+#include <map>
+#include <random>
+
 #include "sim.h"
 
 #define NO_ALT_END -2
+#define SUPPORT_EPS 1e-3        // Max. expected number of samples of a basis state pruned from the support
+#define PROB_EPS 1e-15          // Probabilities below this value are treated as rounding errors
+#define DROPPED_EPS 1e-3        // Max. expected number of samples of all basis states pruned from the support
+#define READ_ERROR "Could not read the input (corrupted or truncated file).\n"
+
+/**
+ * Reports an unexpected end of the input, unless the end was caused by a read error of the stream
+ * (e.g. of a truncated compressed file), which is reported instead
+ */
+static void eof_error(FILE *in, const char *msg)
+{
+    if (ferror(in)) {
+        io_error_exit(READ_ERROR);
+    }
+    error_exit("%s", msg);
+}
 
 /**
  * Function for number parsing from the input file (reads the number from the input until the end character is encountered)
  * Checks for two possible end characters. If only one character should be checked agains, set alt_end to NO_ALT_END.
+ * The encountered end character is stored to found_end (if not NULL).
  */
-static long long parse_num(FILE *in, char end, char alt_end)
+static long long parse_num(FILE *in, char end, char alt_end, int *found_end)
 {
     int c = fgetc(in);
     char num[NUM_MAX_LEN] = {0};
@@ -20,7 +41,7 @@ static long long parse_num(FILE *in, char end, char alt_end)
     // Load number to string
     while ( c != end && c != alt_end) {
         if (c == EOF) {
-            error_exit("Invalid format - reached an unexpected end of file when converting a number.\n");
+            eof_error(in, "Invalid format - reached an unexpected end of file when converting a number.\n");
         }
         else if (!isdigit(c) && c != '-') {
             // Check if isn't just trailing whitespace
@@ -44,6 +65,10 @@ static long long parse_num(FILE *in, char end, char alt_end)
         c = fgetc(in);
     }
 
+    if (found_end != NULL) {
+        *found_end = c;
+    }
+
     // Convert to integer value
     char *ptr;
     errno = 0;
@@ -64,11 +89,11 @@ static uint32_t get_q_num(FILE *in)
 
     while ((c = fgetc(in)) != '[') {
         if (c == EOF) {
-            error_exit("Invalid format - reached an unexpected end of file (expected a qubit index).\n");
+            eof_error(in, "Invalid format - reached an unexpected end of file (expected a qubit index).\n");
         }
     }
 
-    n = parse_num(in, ']', NO_ALT_END);
+    n = parse_num(in, ']', NO_ALT_END, NULL);
     if (n > UINT32_MAX || n < 0) {
         error_exit("Invalid format - not a valid qubit identifier.\n");
     }
@@ -84,23 +109,19 @@ static uint64_t get_iters(FILE *in)
     int c;
     long long start, end;
     long long step = 1;
-    fpos_t second_num_pos;
     uint64_t iters;
 
     while ((c = fgetc(in)) != '[') {
         if (c == EOF) {
-            error_exit("Invalid format - reached an unexpected end of file (expected a number of loop iterations).\n");
+            eof_error(in, "Invalid format - reached an unexpected end of file (expected a number of loop iterations).\n");
         }
     }
 
-    start = parse_num(in, ':', NO_ALT_END);
-    end = parse_num(in, ']', ':');
-    if (fseek(in, -1, SEEK_CUR) != 0) {
-        error_exit("Error has occured when parsing loop parameters (fseek error).\n");
-    }
-    if ((c = fgetc(in)) == ':') {
+    start = parse_num(in, ':', NO_ALT_END, NULL);
+    end = parse_num(in, ']', ':', &c);
+    if (c == ':') {
         step = end;
-        end = parse_num(in, ']', NO_ALT_END);
+        end = parse_num(in, ']', NO_ALT_END, NULL);
     }
     
     // Note: expects 64bit long long
@@ -123,19 +144,41 @@ static uint64_t get_iters(FILE *in)
     return ((uint64_t) iters);
 }
 
-void sim_file(FILE *in, QuantumCircuit *circ, int *n_qubits, int **bits_to_measure, bool *is_measure)
+/**
+ * Skips all remaining characters of the current statement (up to ';')
+ */
+static void skip_stmt(FILE *in)
+{
+    int c;
+    while ((c = fgetc(in)) != ';') {
+        if (c == EOF) {
+            eof_error(in, "Invalid format - reached an unexpected end of file (expected ';' to end the current line).\n");
+        }
+    }
+}
+
+/**
+ * Result of parsing a single statement
+ */
+typedef enum stmt {
+    STMT_EOF,
+    STMT_QREG,       // qubit register declaration (the register size is the only operand)
+    STMT_GATE        // gate, measurement or a loop boundary
+} stmt_t;
+
+/**
+ * Parses the next statement of the QASM file (init is true if the qubit register has already been declared)
+ */
+static stmt_t parse_stmt(FILE *in, bool init, gate_t *g)
 {
-    //TODO: refactoring
     //TODO: add line counter and display in errors
     int c;
     char cmd[CMD_MAX_LEN];
-    bool init = false;
-
-    bool is_loop = false;
-    bool loop_first = true;
-    fpos_t loop_start;
     uint64_t iters;
 
+    g->qubits.clear();
+    g->iters = 0;
+
     while ((c = fgetc(in)) != EOF) {
         for (int i=0; i < CMD_MAX_LEN; i++) {
             cmd[i] = '\0';
@@ -146,7 +189,7 @@ void sim_file(FILE *in, QuantumCircuit *circ, int *n_qubits, int **bits_to_measu
         }
 
         if (c == EOF) {
-            return;
+            return STMT_EOF;
         }
 
         // Skip one-line comments
@@ -154,7 +197,7 @@ void sim_file(FILE *in, QuantumCircuit *circ, int *n_qubits, int **bits_to_measu
             if ((c = fgetc(in)) == '/') {
                 while ((c = fgetc(in)) != '\n') {
                     if (c == EOF) {
-                        return;
+                        return STMT_EOF;
                     }
                 }
                 continue;
@@ -167,7 +210,7 @@ void sim_file(FILE *in, QuantumCircuit *circ, int *n_qubits, int **bits_to_measu
         // Load the command
         do {
             if (c == EOF) {
-                error_exit("Invalid format - reached an unexpected end of file when loading a command.\n");
+                eof_error(in, "Invalid format - reached an unexpected end of file when loading a command.\n");
             }
             else if (strlen(cmd) + 1 < CMD_MAX_LEN) {
                 int *temp = &c;
@@ -179,22 +222,18 @@ void sim_file(FILE *in, QuantumCircuit *circ, int *n_qubits, int **bits_to_measu
         } while (!isspace(c = fgetc(in)));
 
         if (c == EOF) {
-            error_exit("Invalid format - reached an unexpected end of file immediately after a command.\n");
+            eof_error(in, "Invalid format - reached an unexpected end of file immediately after a command.\n");
         }
 
         // Identify the command
-        if (strcmp(cmd, "OPENQASM") == 0) {}
-        else if (strcmp(cmd, "include") == 0) {}
-        else if (strcmp(cmd, "creg") == 0) {} //TODO: check if is valid?
+        stmt_t stmt = STMT_GATE;
+        if (strcmp(cmd, "OPENQASM") == 0 || strcmp(cmd, "include") == 0 || strcmp(cmd, "creg") == 0) { //TODO: check if creg is valid?
+            skip_stmt(in);
+            continue;
+        }
         else if (strcmp(cmd, "qreg") == 0) {
-            uint32_t n = get_q_num(in);
-            circ->setNumQubits(n);
-            *n_qubits = (int)n;
-            *bits_to_measure = (int*)my_malloc(n * sizeof(int));
-            for (int i=0; i < n; i++) {
-                (*bits_to_measure)[i] = -1;
-            }
-            init = true;
+            g->qubits.push_back(get_q_num(in));
+            stmt = STMT_QREG;
         }
         else if (init) {
             if (strcmp(cmd, "for") == 0) {
@@ -203,102 +242,93 @@ void sim_file(FILE *in, QuantumCircuit *circ, int *n_qubits, int **bits_to_measu
                     // skip symbolic
                     while ((c = fgetc(in)) != '}') { //TODO: check for comments - shouldn't count commented }
                         if (c == EOF) {
-                            error_exit("Invalid format - reached an unexpected end of file (there is an unfinished loop).\n");
+                            eof_error(in, "Invalid format - reached an unexpected end of file (there is an unfinished loop).\n");
                         }
                     }
                     continue;
                 }
                 while ((c = fgetc(in)) != '{') {
                     if (c == EOF) {
-                        error_exit("Invalid format - reached an unexpected end of file at the start of a loop.\n");
+                        eof_error(in, "Invalid format - reached an unexpected end of file at the start of a loop.\n");
                     }
                 }
-                is_loop = true; // TODO: allow nested loops?
-                if (fgetpos(in, &loop_start) != 0) {
-                    error_exit("Could not get the current position of the stream to mark the start of a loop.\n");
-                }
-                continue; // ';' not expected
+                g->type = GATE_LOOP;
+                g->iters = iters;
+                return stmt; // ';' not expected
             }
             else if (strcmp(cmd, "}") == 0) {
-                if (!is_loop) {
-                    error_exit("Invalid loop syntax - reached an unexpected end of a loop.\n");
-                }
-                iters--;
-                if (!iters) {
-                    is_loop = false;
-                }
-                else { // next iteration
-                    if (fsetpos(in, &loop_start) != 0) {
-                        error_exit("Could not set a new position of the stream.\n");
-                    }
-                }
-                continue; // ';' not expected
+                g->type = GATE_LOOP_END;
+                return stmt; // ';' not expected
             }
             else if (strcmp(cmd, "measure") == 0) {
-                uint32_t qt = get_q_num(in);
-                uint32_t ct = get_q_num(in);
-                *is_measure = true;
-                (*bits_to_measure)[qt] = ct;
+                g->type = GATE_MEASURE;
+                g->qubits.push_back(get_q_num(in));
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "x") == 0) {
-                uint32_t qt = get_q_num(in);
-                circ->ApplyNOTGate(qt);
+                g->type = GATE_X;
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "y") == 0) {
-                uint32_t qt = get_q_num(in);
-                circ->ApplyPauliYGate(qt);
+                g->type = GATE_Y;
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "z") == 0) {
-                uint32_t qt = get_q_num(in);
-                circ->ApplyPauliZGate(qt);
+                g->type = GATE_Z;
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "h") == 0) {
-                uint32_t qt = get_q_num(in);
-                circ->ApplyHadamardGate(qt);
+                g->type = GATE_H;
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "s") == 0) {
-                uint32_t qt = get_q_num(in);
-                circ->ApplySGate(qt);
+                g->type = GATE_S;
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "t") == 0) {
-                uint32_t qt = get_q_num(in);
-                circ->ApplyTGate(qt);
+                g->type = GATE_T;
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "rx(pi/2)") == 0) {
-                uint32_t qt = get_q_num(in);
-                circ->ApplySXGate(qt);
+                g->type = GATE_SX;
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "ry(pi/2)") == 0) {
-                uint32_t qt = get_q_num(in);
-                circ->ApplySYGate(qt);
+                g->type = GATE_SY;
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "cx") == 0) {
-                uint32_t qc = get_q_num(in);
-                uint32_t qt = get_q_num(in);
-                circ->ApplyCNOTGate(qc, qt);
+                g->type = GATE_CX;
+                g->qubits.push_back(get_q_num(in));
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "cz") == 0) {
-                uint32_t qc = get_q_num(in);
-                uint32_t qt = get_q_num(in);
-                circ->ApplyCZGate(qc, qt);
+                g->type = GATE_CZ;
+                g->qubits.push_back(get_q_num(in));
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "ccx") == 0) {
-                uint32_t qc1 = get_q_num(in);
-                uint32_t qc2 = get_q_num(in);
-                uint32_t qt = get_q_num(in);
-                circ->ApplyCCNOTGate(qc1, qc2, qt);
+                g->type = GATE_CCX;
+                g->qubits.push_back(get_q_num(in));
+                g->qubits.push_back(get_q_num(in));
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "cswap") == 0) {
-                uint32_t qc = get_q_num(in);
-                uint32_t qt1 = get_q_num(in);
-                uint32_t qt2 = get_q_num(in);
-                circ->ApplyCSwapGate(qc, qt1, qt2);
+                g->type = GATE_CSWAP;
+                g->qubits.push_back(get_q_num(in));
+                g->qubits.push_back(get_q_num(in));
+                g->qubits.push_back(get_q_num(in));
+            }
+            else if (strcasecmp(cmd, "swap") == 0) {
+                g->type = GATE_SWAP;
+                g->qubits.push_back(get_q_num(in));
+                g->qubits.push_back(get_q_num(in));
             }
             else if (strcasecmp(cmd, "mcx") == 0) {
-                std::vector<long int> controllers;
+                g->type = GATE_MCX;
                 // Read all control qubits and the target qubit (the last param)
                 while(true) {
-                    controllers.push_back(get_q_num(in));
+                    g->qubits.push_back(get_q_num(in));
                     c = fgetc(in);
                     while (isspace(c)) {
                         c = fgetc(in);
@@ -314,11 +344,7 @@ void sim_file(FILE *in, QuantumCircuit *circ, int *n_qubits, int **bits_to_measu
                         error_exit("Invalid 'mcx' gate syntax.\n");
                     }
                 }
-                uint32_t qt = controllers.back();
-                controllers.pop_back();
-
-                circ->ApplyMCXGate(controllers, qt);
-                continue; // ';' already encountered
+                return stmt; // ';' already encountered
             }
             else {
                 error_exit("Invalid command '%s'.\n", cmd);
@@ -329,26 +355,468 @@ void sim_file(FILE *in, QuantumCircuit *circ, int *n_qubits, int **bits_to_measu
         }
 
         // Skip all remaining characters on the currently read line
-        while ((c = fgetc(in)) != ';') {
-            if (c == EOF) {
-                error_exit("Invalid format - reached an unexpected end of file (expected ';' to end the current line).\n");
+        skip_stmt(in);
+        return stmt;
+    } // while
+
+    return STMT_EOF;
+}
+
+void sim_init(sim_state_t *st, int n)
+{
+    st->circ->setNumQubits(n);
+    st->n_qubits = n;
+    st->bits_to_measure.assign(n, -1);
+    st->is_measure = false;
+    st->phys.resize(n);
+    for (int i = 0; i < n; i++) {
+        st->phys[i] = i;
+    }
+    st->pending.clear();
+}
+
+/**
+ * Applies a gate given over the logical qubits
+ */
+static void apply_logical(sim_state_t *st, const gate_t *g)
+{
+    gate_t pg = *g;
+    for (long int& q : pg.qubits) {
+        q = st->phys[q];
+    }
+    apply_gate(st->circ, &pg);
+}
+
+/**
+ * Swaps two logical qubits by relabeling them (no gate is applied)
+ */
+static void relabel(sim_state_t *st, long int a, long int b)
+{
+    sim_flush(st);
+    long int tmp = st->phys[a];
+    st->phys[a] = st->phys[b];
+    st->phys[b] = tmp;
+}
+
+/**
+ * Buffers a cx gate until it is known whether it is a part of a swap (cx a,b; cx b,a; cx a,b)
+ */
+static void sim_cx(sim_state_t *st, const gate_t *g)
+{
+    if (g->qubits[0] == g->qubits[1]) {
+        sim_flush(st);
+        apply_logical(st, g);
+        return;
+    }
+
+    st->pending.push_back(*g);
+    // Apply the buffered gates until they form the beginning of a swap
+    while (true) {
+        bool is_prefix = true;
+        for (size_t i = 1; i < st->pending.size() && is_prefix; i++) {
+            is_prefix = (st->pending[i].qubits[0] == st->pending[i - 1].qubits[1]
+                         && st->pending[i].qubits[1] == st->pending[i - 1].qubits[0]);
+        }
+        if (is_prefix) {
+            break;
+        }
+        apply_logical(st, &st->pending.front());
+        st->pending.erase(st->pending.begin());
+    }
+
+    if (st->pending.size() == 3) {
+        long int a = st->pending[0].qubits[0];
+        long int b = st->pending[0].qubits[1];
+        st->pending.clear();
+        relabel(st, a, b);
+    }
+}
+
+void sim_flush(sim_state_t *st)
+{
+    for (const gate_t& g : st->pending) {
+        apply_logical(st, &g);
+    }
+    st->pending.clear();
+}
+
+std::string sim_to_physical(const sim_state_t *st, const std::string& bits)
+{
+    int n = st->n_qubits;
+    if (bits.length() != (size_t)n) {
+        return bits; // invalid length is reported by the caller
+    }
+    std::string res(bits);
+    for (int q = 0; q < n; q++) {
+        res[n - 1 - st->phys[q]] = bits[n - 1 - q];
+    }
+    return res;
+}
+
+/**
+ * Simulates a single gate or a measurement
+ */
+static void sim_gate(sim_state_t *st, const gate_t *g)
+{
+    if (!gate_has_operands(g)) {
+        error_exit("Invalid gate (wrong number of operands for the operation type %d).\n", g->type);
+    }
+    size_t n_operands = (g->type == GATE_MEASURE) ? 1 : g->qubits.size();
+    for (size_t i = 0; i < n_operands; i++) {
+        if (g->qubits[i] < 0 || g->qubits[i] >= st->n_qubits) {
+            error_exit("Invalid qubit index %ld (the circuit has %d qubits).\n", g->qubits[i], st->n_qubits);
+        }
+    }
+
+    if (g->type == GATE_MEASURE) {
+        st->is_measure = true;
+        st->bits_to_measure[g->qubits[0]] = g->qubits[1];
+    }
+    else if (g->type == GATE_SWAP) {
+        relabel(st, g->qubits[0], g->qubits[1]);
+    }
+    else if (g->type == GATE_CX) {
+        sim_cx(st, g);
+    }
+    else {
+        sim_flush(st);
+        apply_logical(st, g);
+    }
+}
+
+bool gate_has_operands(const gate_t *g)
+{
+    size_t n = g->qubits.size();
+    switch (g->type) {
+        case GATE_X:
+        case GATE_Y:
+        case GATE_Z:
+        case GATE_H:
+        case GATE_S:
+        case GATE_T:
+        case GATE_SX:
+        case GATE_SY:
+            return n == 1;
+        case GATE_CX:
+        case GATE_CZ:
+        case GATE_SWAP:
+        case GATE_MEASURE:
+            return n == 2;
+        case GATE_CCX:
+        case GATE_CSWAP:
+            return n == 3;
+        case GATE_MCX:
+            return n >= 2;
+        default:
+            return true; // loop boundaries have no operands, unsupported types are reported when applied
+    }
+}
+
+void apply_gate(QuantumCircuit *circ, const gate_t *g)
+{
+    switch (g->type) {
+        case GATE_X:
+            circ->ApplyNOTGate(g->qubits[0]);
+            break;
+        case GATE_Y:
+            circ->ApplyPauliYGate(g->qubits[0]);
+            break;
+        case GATE_Z:
+            circ->ApplyPauliZGate(g->qubits[0]);
+            break;
+        case GATE_H:
+            circ->ApplyHadamardGate(g->qubits[0]);
+            break;
+        case GATE_S:
+            circ->ApplySGate(g->qubits[0]);
+            break;
+        case GATE_T:
+            circ->ApplyTGate(g->qubits[0]);
+            break;
+        case GATE_SX:
+            circ->ApplySXGate(g->qubits[0]);
+            break;
+        case GATE_SY:
+            circ->ApplySYGate(g->qubits[0]);
+            break;
+        case GATE_CX:
+            circ->ApplyCNOTGate(g->qubits[0], g->qubits[1]);
+            break;
+        case GATE_CZ:
+            circ->ApplyCZGate(g->qubits[0], g->qubits[1]);
+            break;
+        case GATE_CCX:
+            circ->ApplyCCNOTGate(g->qubits[0], g->qubits[1], g->qubits[2]);
+            break;
+        case GATE_CSWAP:
+            circ->ApplyCSwapGate(g->qubits[0], g->qubits[1], g->qubits[2]);
+            break;
+        case GATE_SWAP:
+            circ->ApplySwapGate(g->qubits[0], g->qubits[1]);
+            break;
+        case GATE_MCX: {
+            std::vector<long int> controllers(g->qubits.begin(), g->qubits.end() - 1);
+            circ->ApplyMCXGate(controllers, g->qubits.back());
+            break;
+        }
+        default:
+            error_exit("Invalid gate (unsupported operation type %d).\n", g->type);
+    }
+}
+
+void sim_file(FILE *in, sim_state_t *st)
+{
+    gate_t g;
+    stmt_t stmt;
+    bool init = false;
+
+    // The loop body is buffered during the first iteration and replayed (the input is not required to be seekable)
+    bool is_loop = false;
+    std::vector<gate_t> loop_body;
+    uint64_t iters = 0;
+
+    while ((stmt = parse_stmt(in, init, &g)) != STMT_EOF) {
+        if (stmt == STMT_QREG) {
+            sim_init(st, g.qubits[0]);
+            init = true;
+        }
+        else if (g.type == GATE_LOOP) {
+            if (is_loop) {
+                error_exit("Nested loops are not supported.\n");
             }
+            is_loop = true;
+            iters = g.iters;
+            loop_body.clear();
         }
-    } // while
+        else if (g.type == GATE_LOOP_END) {
+            if (!is_loop) {
+                error_exit("Invalid loop syntax - reached an unexpected end of a loop.\n");
+            }
+            is_loop = false;
+            for (uint64_t i = 1; i < iters; i++) {
+                for (const gate_t& body_gate : loop_body) {
+                    sim_gate(st, &body_gate);
+                }
+            }
+        }
+        else {
+            sim_gate(st, &g);
+            if (is_loop) {
+                loop_body.push_back(g);
+            }
+        }
+    }
+    if (ferror(in)) {
+        io_error_exit(READ_ERROR);
+    }
+    if (is_loop) {
+        error_exit("Invalid format - reached an unexpected end of file (there is an unfinished loop).\n");
+    }
+    sim_flush(st);
+}
+
+void parse_file(FILE *in, circuit_t *circuit)
+{
+    gate_t g;
+    stmt_t stmt;
+    bool init = false;
+    bool is_loop = false;
+
+    circuit->n_qubits = 0;
+    circuit->gates.clear();
+
+    while ((stmt = parse_stmt(in, init, &g)) != STMT_EOF) {
+        if (stmt == STMT_QREG) {
+            if (init) {
+                error_exit("Multiple qubit registers are not supported.\n");
+            }
+            circuit->n_qubits = g.qubits[0];
+            init = true;
+            continue;
+        }
+        else if (g.type == GATE_LOOP) {
+            if (is_loop) {
+                error_exit("Nested loops are not supported.\n");
+            }
+            is_loop = true;
+        }
+        else if (g.type == GATE_LOOP_END) {
+            if (!is_loop) {
+                error_exit("Invalid loop syntax - reached an unexpected end of a loop.\n");
+            }
+            is_loop = false;
+        }
+        circuit->gates.push_back(g);
+    }
+
+    if (ferror(in)) {
+        io_error_exit(READ_ERROR);
+    }
+    if (is_loop) {
+        error_exit("Invalid format - reached an unexpected end of file (there is an unfinished loop).\n");
+    }
 }
 
-void measure_all(unsigned long samples, FILE *output, QuantumCircuit *circ, int n)
+void sim_circuit(const circuit_t *circuit, sim_state_t *st)
+{
+    if (circuit->n_qubits <= 0 && !circuit->gates.empty()) {
+        error_exit("Circuit not initialized.\n");
+    }
+    sim_init(st, circuit->n_qubits);
+    sim_gates(circuit->gates, 0, circuit->gates.size(), st);
+}
+
+void sim_gates(const std::vector<gate_t>& gates, size_t begin, size_t end, sim_state_t *st)
+{
+    size_t loop_start = 0;
+    uint64_t iters = 0;
+    bool is_loop = false;
+
+    for (size_t i = begin; i < end; i++) {
+        if (gates[i].type == GATE_LOOP) {
+            if (is_loop) {
+                error_exit("Nested loops are not supported.\n");
+            }
+            is_loop = (gates[i].iters != 0);
+            if (!is_loop) {
+                // skip the loop body
+                while (i < end && gates[i].type != GATE_LOOP_END) {
+                    i++;
+                }
+                continue;
+            }
+            iters = gates[i].iters;
+            loop_start = i;
+        }
+        else if (gates[i].type == GATE_LOOP_END) {
+            if (!is_loop) {
+                error_exit("Invalid loop syntax - reached an unexpected end of a loop.\n");
+            }
+            iters--;
+            if (!iters) {
+                is_loop = false;
+            }
+            else { // next iteration
+                i = loop_start;
+            }
+        }
+        else {
+            sim_gate(st, &gates[i]);
+        }
+    }
+    if (is_loop) {
+        error_exit("Invalid loop syntax - the loop has no end.\n");
+    }
+    sim_flush(st);
+}
+
+htab_t* measure_all(unsigned long samples, QuantumCircuit *circ, int n)
 {
     std::string curr_state;
 
-    htab_t *state_table = htab_init(n*n); //TODO: is optimal?
+    htab_t *state_table = htab_init(n*n + 1); //TODO: is optimal?
     
     for (unsigned long i=0; i < samples; i++) {
         curr_state = circ->Measure();
         htab_m_lookup_add(state_table, (htab_m_key_t)(curr_state.c_str()));
     }
-    htab_m_print_all(state_table, output);
-    htab_m_free(state_table);
+    return state_table;
+}
+
+typedef struct support_ctx {     // State of the support enumeration
+    QuantumCircuit *circ;
+    int n;
+    long double eps;             // Prefixes with a lower probability are pruned
+    long double dropped;         // Total probability of the pruned prefixes
+    long double max_dropped;     // Max. total probability of the pruned prefixes
+    size_t max_support;
+    std::map<unsigned int, int> prefix; // Values of the already enumerated qubits
+    std::string state;           // The current basis state (LSBF)
+    std::vector<std::pair<std::string, long double>> support;
+} support_ctx_t;
+
+/**
+ * Enumerates the support below the current prefix with the probability p (depth-first over the qubits),
+ * returns false if the support is too large or too much probability was pruned
+ */
+static bool enum_support(support_ctx_t *ctx, long double p)
+{
+    int q = ctx->prefix.size();
+    if (q == ctx->n) {
+        if (ctx->support.size() >= ctx->max_support) {
+            return false;
+        }
+        ctx->support.push_back(std::make_pair(ctx->state, p));
+        return true;
+    }
+
+    ctx->prefix[q] = 0;
+    long double p0 = ctx->circ->GetProbability(ctx->prefix);
+    if (p0 > p) {
+        p0 = p;
+    }
+    long double p1 = p - p0; // saves a query of the backend
+    bool ok = true;
+    if (p0 > ctx->eps) {
+        ctx->state[q] = '0';
+        ok = enum_support(ctx, p0);
+    }
+    else {
+        ctx->dropped += p0;
+    }
+    if (ok && p1 > ctx->eps) {
+        ctx->prefix[q] = 1;
+        ctx->state[q] = '1';
+        ok = enum_support(ctx, p1);
+    }
+    else if (ok) {
+        ctx->dropped += p1;
+    }
+    ctx->prefix.erase(q);
+    return ok && ctx->dropped <= ctx->max_dropped;
+}
+
+htab_t* measure_all_multinomial(unsigned long samples, QuantumCircuit *circ, int n, size_t max_support, uint64_t seed,
+                                size_t *support_size)
+{
+    support_ctx_t ctx;
+    ctx.circ = circ;
+    ctx.n = n;
+    ctx.eps = std::max((long double)SUPPORT_EPS / samples, (long double)PROB_EPS);
+    ctx.dropped = 0;
+    ctx.max_dropped = std::max((long double)DROPPED_EPS / samples, (long double)PROB_EPS);
+    ctx.max_support = max_support;
+    ctx.state.assign(n, '0');
+    *support_size = 0;
+    if (!enum_support(&ctx, 1) || ctx.support.empty()) {
+        return NULL;
+    }
+
+    // Multinomial draw as a sequence of binomial draws (conditioned on the remaining samples), the pruned states
+    // form the last outcome, so the kept probabilities are never scaled up
+    long double rest = 1; // probability of the outcomes not drawn yet
+    std::mt19937_64 rng(seed);
+    htab_t *state_table = htab_init(ctx.support.size() + 1);
+    unsigned long left = samples;
+    for (size_t i = 0; i < ctx.support.size() && left > 0; i++) {
+        unsigned long count = left;
+        if (ctx.support[i].second < rest) {
+            std::binomial_distribution<unsigned long> binom(left, (double)(ctx.support[i].second / rest));
+            count = binom(rng);
+        }
+        rest -= ctx.support[i].second;
+        left -= count;
+        if (count > 0) {
+            htab_m_lookup_add_count(state_table, (htab_m_key_t)(ctx.support[i].first.c_str()), count);
+        }
+    }
+    if (left > 0) {
+        // some samples fell to the pruned states (with probability at most DROPPED_EPS), they are not known
+        htab_m_free(state_table);
+        return NULL;
+    }
+    *support_size = ctx.support.size();
+    return state_table;
 }
 
-/* end of "sim.c" */
\ No newline at end of file
+/* end of "sim.c" */
@@ -3,6 +3,8 @@
 #include <errno.h>
 #include <stdint.h>
 #include <limits.h>
+#include <string>
+#include <vector>
 
 #include "error.h"
 #include "htab.h"
@@ -15,34 +17,158 @@
 #define NUM_MAX_LEN 25 // Max. number of characters in a parsed number
 
 /**
- * Parses a given QASM file and simulates this circuit
+ * Operations of the circuit
+ */
+typedef enum gate_type {
+    GATE_X,
+    GATE_Y,
+    GATE_Z,
+    GATE_H,
+    GATE_S,
+    GATE_T,
+    GATE_SX,         // rx(pi/2)
+    GATE_SY,         // ry(pi/2)
+    GATE_CX,
+    GATE_CZ,
+    GATE_CCX,
+    GATE_CSWAP,
+    GATE_MCX,
+    GATE_SWAP,
+    GATE_MEASURE,    // operands: the measured qubit and the classical bit
+    GATE_LOOP,       // start of a loop body (loops cannot be nested)
+    GATE_LOOP_END    // end of a loop body
+} gate_type_t;
+
+typedef struct gate {            // Single operation of the circuit
+    gate_type_t type;
+    std::vector<long int> qubits;  // Operands (the control qubits first, the target qubits last)
+    uint64_t iters;              // Number of iterations (only for GATE_LOOP)
+} gate_t;
+
+typedef struct circuit {         // Parsed circuit
+    int n_qubits;
+    std::vector<gate_t> gates;
+} circuit_t;
+
+typedef struct sim_state {       // State of the circuit simulation
+    QuantumCircuit *circ;        // The state vector of the circuit
+    int n_qubits;                // Number of qubits in the circuit
+    std::vector<int> bits_to_measure; // Classical bit for every qubit (-1 if the qubit is not measured)
+    bool is_measure;             // True if some measure operation is present
+    std::vector<long int> phys;  // Physical qubit holding every logical qubit (a swap only relabels the qubits)
+    std::vector<gate_t> pending; // Buffered cx gates that may form a swap (cx a,b; cx b,a; cx a,b)
+} sim_state_t;
+
+/**
+ * Parses a given QASM file and simulates this circuit (the gates are applied as soon as they are parsed)
  * 
  * @param in input QASM file
  * 
- * @param circ the state vector of the circuit
+ * @param st simulation state (the backend must be set)
  * 
- * @param n_qubits number of qubits in the circuit
+ */
+void sim_file(FILE *in, sim_state_t *st);
+
+/**
+ * Parses a given QASM file into a list of gates
  * 
- * @param bits_to_measure array for storing the qubits that are to be measured
+ * @param in input QASM file
  * 
- * @param is_measure true if some measure operation is present
+ * @param circuit the parsed circuit
  * 
  */
-void sim_file(FILE *in, QuantumCircuit *circ, int *n_qubits, int **bits_to_measure, bool *is_measure);
+void parse_file(FILE *in, circuit_t *circuit);
 
 /**
- * Measures all bits in the given array (compatible only with measurement at the end of the circuit)
+ * Simulates an already parsed circuit
  * 
- * @param samples the total number of samples
+ * @param circuit the circuit
+ * 
+ * @param st simulation state (the backend must be set)
+ * 
+ */
+void sim_circuit(const circuit_t *circuit, sim_state_t *st);
+
+/**
+ * Simulates the gates in the range [begin, end) of an already initialized circuit (the range must not split a loop)
+ * 
+ * @param gates the gates of the circuit
+ * 
+ * @param begin index of the first simulated gate
+ * 
+ * @param end index after the last simulated gate
+ * 
+ * @param st simulation state (must be initialized)
+ * 
+ */
+void sim_gates(const std::vector<gate_t>& gates, size_t begin, size_t end, sim_state_t *st);
+
+/**
+ * Initializes the simulation state (and the backend) for a circuit with n qubits
+ */
+void sim_init(sim_state_t *st, int n);
+
+/**
+ * Applies all buffered gates, so that the state vector is complete (called at the end of every simulation)
+ */
+void sim_flush(sim_state_t *st);
+
+/**
+ * Converts a bit string over the logical qubits (the last character is qubit 0) to the physical qubits
+ */
+std::string sim_to_physical(const sim_state_t *st, const std::string& bits);
+
+/**
+ * Returns true if the gate has the number of operands required by its type (the qubit indices are not checked)
+ */
+bool gate_has_operands(const gate_t *g);
+
+/**
+ * Applies a single gate (not a measurement or a loop boundary) to the state vector, the operands are physical qubits
+ */
+void apply_gate(QuantumCircuit *circ, const gate_t *g);
+
+/**
+ * Samples all qubits (compatible only with measurement at the end of the circuit)
  * 
- * @param output stream for the output of results
+ * @param samples the total number of samples
  * 
  * @param circ the state vector of the circuit
  * 
  * @param n number of qubits in the circuit
  * 
+ * @return table of the sampled states (stored as LSBF) and their counts, has to be freed by the caller
+ * 
+ */
+htab_t* measure_all(unsigned long samples, QuantumCircuit *circ, int n);
+
+/**
+ * Samples all qubits in time independent of the number of samples: the basis states with a non-negligible
+ * probability (the outcome support) are enumerated from the final state and all counts are drawn from their exact
+ * probabilities by a single multinomial draw (compatible only with measurement at the end of the circuit).
+ * The pruned basis states are kept as a separate outcome of the draw, so that the probabilities of the enumerated
+ * states are not rescaled.
+ *
+ * @param samples the total number of samples
+ *
+ * @param circ the state vector of the circuit
+ *
+ * @param n number of qubits in the circuit
+ *
+ * @param max_support max. size of the enumerated support
+ *
+ * @param seed seed of the multinomial draw
+ *
+ * @param support_size the size of the enumerated support
+ *
+ * @return table of the sampled states (stored as LSBF) and their counts, has to be freed by the caller,
+ *         NULL if the support is larger than max_support, if the pruned states together are expected to get
+ *         a non-negligible number of samples or if some samples were drawn for them (the caller should fall back
+ *         to measure_all())
+ *
  */
-void measure_all(unsigned long samples, FILE *output, QuantumCircuit *circ, int n);
+htab_t* measure_all_multinomial(unsigned long samples, QuantumCircuit *circ, int n, size_t max_support, uint64_t seed,
+                                size_t *support_size);
 
 #endif
 /* end of "sim.h" */
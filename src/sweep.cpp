@@ -0,0 +1,385 @@
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "sweep.h"
+#include "input.h"
+
+typedef struct sweep_circ {      // Circuit of the sweep
+    const char *path;
+    circuit_t circuit;
+    std::vector<size_t> units;   // Start of every unit (a gate or a whole loop) followed by the end of the gate list
+} sweep_circ_t;
+
+typedef struct trie_node {       // Node of the prefix trie (a sequence of units shared by all circuits in the subtree)
+    size_t circ;                 // Circuit providing the gates of the node
+    size_t begin;                // First unit of the node
+    size_t end;                  // Unit after the last unit of the node
+    std::vector<size_t> leaves;  // Circuits ending in this node
+    std::vector<trie_node> children;
+} trie_node_t;
+
+typedef struct sweep_ctx {       // State of the sweep
+    std::vector<sweep_circ_t> circs;
+    const qsim_opts_t *opts;
+    bool info;
+    FILE *output;
+    double *times;               // Estimated simulation time of an independent run of every circuit, without parsing
+                                 // and initialization (shared with the forked processes)
+    sim_state_t st;
+} sweep_ctx_t;
+
+/**
+ * Returns the current value of the monotonic clock in seconds
+ */
+static double get_time()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1.0e-9;
+}
+
+/**
+ * Splits the circuit into units, loops are kept as a single unit so that a branch point never splits a loop
+ */
+static void split_units(sweep_circ_t *c)
+{
+    const std::vector<gate_t>& gates = c->circuit.gates;
+    c->units.clear();
+    for (size_t i = 0; i < gates.size(); i++) {
+        c->units.push_back(i);
+        if (gates[i].type == GATE_LOOP) {
+            while (i < gates.size() && gates[i].type != GATE_LOOP_END) {
+                i++;
+            }
+        }
+    }
+    c->units.push_back(gates.size());
+}
+
+/**
+ * Returns the number of units of the circuit
+ */
+static inline size_t n_units(const sweep_circ_t *c)
+{
+    return c->units.size() - 1;
+}
+
+/**
+ * Returns true if the u-th units of both circuits are the same
+ */
+static bool unit_eq(const sweep_circ_t *a, const sweep_circ_t *b, size_t u)
+{
+    size_t len = a->units[u + 1] - a->units[u];
+    if (len != b->units[u + 1] - b->units[u]) {
+        return false;
+    }
+    for (size_t k = 0; k < len; k++) {
+        const gate_t& ga = a->circuit.gates[a->units[u] + k];
+        const gate_t& gb = b->circuit.gates[b->units[u] + k];
+        if (ga.type != gb.type || ga.qubits != gb.qubits || ga.iters != gb.iters) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Builds the prefix trie of the given circuits, all of them share the units before depth
+ */
+static void build_trie(const sweep_ctx_t *ctx, trie_node_t *node, const std::vector<size_t>& idxs, size_t depth)
+{
+    const sweep_circ_t *rep = &ctx->circs[idxs[0]];
+
+    // Find the longest shared prefix
+    size_t len = depth;
+    bool shared = true;
+    while (shared && len < n_units(rep)) {
+        for (size_t i : idxs) {
+            if (len >= n_units(&ctx->circs[i]) || !unit_eq(rep, &ctx->circs[i], len)) {
+                shared = false;
+                break;
+            }
+        }
+        if (shared) {
+            len++;
+        }
+    }
+    node->circ = idxs[0];
+    node->begin = depth;
+    node->end = len;
+
+    // Partition the remaining circuits by their next unit
+    std::vector<std::vector<size_t>> branches;
+    for (size_t i : idxs) {
+        if (len == n_units(&ctx->circs[i])) {
+            node->leaves.push_back(i);
+            continue;
+        }
+        size_t b;
+        for (b = 0; b < branches.size(); b++) {
+            if (unit_eq(&ctx->circs[branches[b][0]], &ctx->circs[i], len)) {
+                break;
+            }
+        }
+        if (b == branches.size()) {
+            branches.emplace_back();
+        }
+        branches[b].push_back(i);
+    }
+
+    node->children.resize(branches.size());
+    for (size_t b = 0; b < branches.size(); b++) {
+        build_trie(ctx, &node->children[b], branches[b], len);
+    }
+}
+
+/**
+ * Returns the number of gates simulated in the subtree
+ */
+static size_t count_gates(const sweep_ctx_t *ctx, const trie_node_t *node)
+{
+    const sweep_circ_t *c = &ctx->circs[node->circ];
+    size_t n = c->units[node->end] - c->units[node->begin];
+    for (const trie_node_t& child : node->children) {
+        n += count_gates(ctx, &child);
+    }
+    return n;
+}
+
+/**
+ * Collects and prints the results of a circuit ending in the current state
+ */
+static bool sweep_finish(sweep_ctx_t *ctx, size_t i, double path_time)
+{
+    const qsim_opts_t& opts = *ctx->opts;
+    qsim_result_t res;
+
+    double t_start = get_time();
+    qsim_status_t status = qsim_collect(&ctx->st, opts, &res);
+    path_time += get_time() - t_start;
+    ctx->times[i] = path_time;
+
+    if (status != QSIM_OK) {
+        fprintf(stderr, "%sCircuit '%s': %s\n", ERROR_TEXT, ctx->circs[i].path, res.error.c_str());
+        return false;
+    }
+    if ((opts.measure && res.is_measure) || !opts.amplitudes.empty() || !opts.expects.empty()) {
+        fprintf(ctx->output, "Circuit '%s':\n", ctx->circs[i].path);
+        qsim_print_result(opts, res, ctx->output);
+    }
+    if (ctx->info) {
+        printf("Circuit '%s' Time=%.3gs\n", ctx->circs[i].path, path_time);
+    }
+    return true;
+}
+
+static bool sweep_node(sweep_ctx_t *ctx, const trie_node_t *node, double path_time);
+
+/**
+ * Simulates the subtree in a forked copy of the current simulation state, returns true on success
+ */
+static bool sweep_fork(sweep_ctx_t *ctx, const trie_node_t *node, double path_time)
+{
+    fflush(stdout);
+    fflush(ctx->output);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "%sCould not fork the simulation state.\n", ERROR_TEXT);
+        return false;
+    }
+    else if (pid == 0) {
+        // _exit() skips the exit handlers and the destructors of the state shared with the parent
+        bool ok = sweep_node(ctx, node, path_time);
+        fflush(stdout);
+        fflush(ctx->output);
+        _exit(ok ? 0 : 1);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "%sCould not wait for the forked simulation.\n", ERROR_TEXT);
+            return false;
+        }
+    }
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "%sCircuit variant simulation terminated by signal %d (%s).\n", ERROR_TEXT, WTERMSIG(status), strsignal(WTERMSIG(status)));
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Simulates the node from the current simulation state and continues with its subtree, returns true on success
+ */
+static bool sweep_node(sweep_ctx_t *ctx, const trie_node_t *node, double path_time)
+{
+    const sweep_circ_t *c = &ctx->circs[node->circ];
+    bool ok = true;
+
+    try {
+        double t_start = get_time();
+        sim_gates(c->circuit.gates, c->units[node->begin], c->units[node->end], &ctx->st);
+        path_time += get_time() - t_start;
+
+        for (size_t i : node->leaves) {
+            ok = sweep_finish(ctx, i, path_time) && ok;
+        }
+    }
+    catch (const SimError& e) {
+        fprintf(stderr, "%sCircuit '%s': %s\n", ERROR_TEXT, c->path, e.what());
+        return false;
+    }
+
+    for (size_t b = 0; b < node->children.size(); b++) {
+        if (b + 1 == node->children.size()) {
+            // the last variant continues from the current state, no snapshot is needed
+            ok = sweep_node(ctx, &node->children[b], path_time) && ok;
+        }
+        else {
+            ok = sweep_fork(ctx, &node->children[b], path_time) && ok;
+        }
+    }
+    return ok;
+}
+
+/**
+ * Initializes the circuit for the given trie and simulates it
+ */
+static bool sweep_trie(sweep_ctx_t *ctx, const trie_node_t *root)
+{
+    double t_start = get_time();
+    sim_init(&ctx->st, ctx->circs[root->circ].circuit.n_qubits);
+    return sweep_node(ctx, root, get_time() - t_start);
+}
+
+int sweep_run(const std::vector<const char*>& paths, QuasimodoSim *sim, const qsim_opts_t& opts, bool info, FILE *output)
+{
+    sweep_ctx_t ctx;
+    ctx.opts = &opts;
+    ctx.info = info;
+    ctx.output = output;
+    ctx.st.circ = sim->get_backend(opts.sim_type);
+    ctx.st.n_qubits = 0;
+    ctx.st.is_measure = false;
+    if (ctx.st.circ == NULL) {
+        error_exit("Invalid simulation backend option '%s'.\n", opts.sim_type.c_str());
+    }
+    if (paths.empty()) {
+        error_exit("No circuits given for the sweep.\n");
+    }
+
+    // Parse all circuits
+    ctx.circs.resize(paths.size());
+    size_t total_gates = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        FILE *in = input_open(paths[i]);
+        if (in == NULL) {
+            error_exit("Invalid input file '%s'.\n", paths[i]);
+        }
+        ctx.circs[i].path = paths[i];
+        parse_file(in, &ctx.circs[i].circuit);
+        fclose(in);
+        if (ctx.circs[i].circuit.n_qubits <= 0) {
+            error_exit("Circuit '%s' has no qubit register.\n", paths[i]);
+        }
+        if (opts.fuse) {
+            fuse_stats_t stats;
+            fuse_circuit(&ctx.circs[i].circuit, &stats);
+        }
+        split_units(&ctx.circs[i]);
+        total_gates += ctx.circs[i].circuit.gates.size();
+    }
+
+    // Build one prefix trie for every circuit width
+    std::vector<std::vector<size_t>> groups;
+    for (size_t i = 0; i < ctx.circs.size(); i++) {
+        size_t g;
+        for (g = 0; g < groups.size(); g++) {
+            if (ctx.circs[groups[g][0]].circuit.n_qubits == ctx.circs[i].circuit.n_qubits) {
+                break;
+            }
+        }
+        if (g == groups.size()) {
+            groups.emplace_back();
+        }
+        groups[g].push_back(i);
+    }
+    std::vector<trie_node_t> tries(groups.size());
+    size_t sim_gates_cnt = 0;
+    for (size_t g = 0; g < groups.size(); g++) {
+        build_trie(&ctx, &tries[g], groups[g], 0);
+        sim_gates_cnt += count_gates(&ctx, &tries[g]);
+    }
+
+    ctx.times = (double*)mmap(NULL, paths.size() * sizeof(double), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ctx.times == MAP_FAILED) {
+        error_exit("Could not allocate the shared sweep statistics.\n");
+    }
+    for (size_t i = 0; i < paths.size(); i++) {
+        ctx.times[i] = 0;
+    }
+
+    // Sim:
+    double t_start = get_time();
+    bool ok = true;
+    {
+        RecoverableErrorGuard recoverable;
+        for (size_t g = 0; g < tries.size(); g++) {
+            if (g + 1 == tries.size()) {
+                ok = sweep_trie(&ctx, &tries[g]) && ok;
+            }
+            else {
+                // circuits of a different width are simulated from scratch in their own process
+                fflush(stdout);
+                fflush(output);
+                pid_t pid = fork();
+                if (pid < 0) {
+                    fprintf(stderr, "%sCould not fork the simulation.\n", ERROR_TEXT);
+                    ok = false;
+                    continue;
+                }
+                else if (pid == 0) {
+                    bool trie_ok = sweep_trie(&ctx, &tries[g]);
+                    fflush(stdout);
+                    fflush(output);
+                    _exit(trie_ok ? 0 : 1);
+                }
+                int status;
+                while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+                ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 && ok;
+            }
+        }
+    }
+    double t_sweep = get_time() - t_start;
+
+    // Output:
+    double t_indep = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        t_indep += ctx.times[i];
+    }
+    printf("Sweep: %zu circuits, %zu of %zu gates simulated\n", paths.size(), sim_gates_cnt, total_gates);
+    printf("Sweep Time=%.3gs\n", t_sweep);
+    printf("Independent Time=%.3gs (estimate: sum of the simulation times of every circuit's gates, "
+           "without parsing and initialization)\n", t_indep);
+    if (info) {
+        #if defined(__unix__) || defined(__APPLE__)
+            struct rusage rs_usage;
+            long peak = qsim_peak_mem();
+            if (getrusage(RUSAGE_CHILDREN, &rs_usage) == 0 && rs_usage.ru_maxrss > peak) {
+                peak = rs_usage.ru_maxrss;
+            }
+            printf("Peak Memory Usage=%ldkB\n", peak);
+        #else
+            printf("Peak Memory Usage not supported for this OS.\n");
+        #endif
+    }
+
+    munmap(ctx.times, paths.size() * sizeof(double));
+    return ok ? 0 : 1;
+}
+
+/* end of "sweep.c" */
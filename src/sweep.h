@@ -0,0 +1,30 @@
+#include <stdio.h>
+#include <vector>
+
+#include "quasimodosim.h"
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+/**
+ * Simulates a set of circuits sharing common prefixes. The parsed circuits are organized into a prefix trie,
+ * every shared prefix is simulated only once and the simulation state at a branch point is snapshotted
+ * by a copy-on-write fork() for every variant.
+ *
+ * @param paths paths to the QASM files of the circuits
+ *
+ * @param sim simulator session providing the backend
+ *
+ * @param opts options of the simulation
+ *
+ * @param info true if the runtime of every circuit and of the whole sweep should be reported
+ *
+ * @param output stream for the output of results
+ *
+ * @return 0 if all circuits were simulated successfully, 1 otherwise
+ *
+ */
+int sweep_run(const std::vector<const char*>& paths, QuasimodoSim *sim, const qsim_opts_t& opts, bool info, FILE *output);
+
+#endif
+/* end of "sweep.h" */